@@ -0,0 +1,102 @@
+//
+// Interned annotations of expansion variables
+//
+
+#include "AnnotationTable.h"
+
+#include <algorithm>
+
+AnnotationTable::AnnotationTable()
+{
+  intern(std::vector<Lit>());
+}
+
+uint64_t AnnotationTable::hash(const Lit* begin, const Lit* end)
+{
+  uint64_t h = 14695981039346656037ULL;
+  for (const Lit* li = begin; li != end; li++)
+    h = (h ^ (uint32_t)*li) * 1099511628211ULL;
+  return h;
+}
+
+bool AnnotationTable::equals(uint32_t id, const Lit* b, const Lit* e) const
+{
+  return (size_t)(end(id) - begin(id)) == (size_t)(e - b) && std::equal(b, e, begin(id));
+}
+
+uint32_t AnnotationTable::intern(const std::vector<Lit>& anno)
+{
+  std::vector<Lit> sorted(anno);
+  std::sort(sorted.begin(), sorted.end(), lit_order);
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+  // annotations restored by assign() are hashed on first use
+  for (uint32_t id = (uint32_t)ids.size(); id < size(); id++)
+    ids.emplace(hash(begin(id), end(id)), id);
+
+  const Lit* b = sorted.data();
+  const Lit* e = b + sorted.size();
+  uint64_t h = hash(b, e);
+  auto range = ids.equal_range(h);
+  for (auto it = range.first; it != range.second; it++)
+    if (equals(it->second, b, e)) return it->second;
+
+  // sorted by variable, a conflict is between neighbours
+  bool ok = true;
+  for (size_t i = 1; ok && i < sorted.size(); i++)
+    ok = var(sorted[i - 1]) != var(sorted[i]);
+
+  uint32_t id = size();
+  lits.insert(lits.end(), b, e);
+  ends.push_back((uint32_t)lits.size());
+  consistent.push_back(ok);
+  ids.emplace(h, id);
+  return id;
+}
+
+void AnnotationTable::assign(const Lit* l, const uint64_t* e, uint32_t n)
+{
+  lits.assign(l, l + (n == 0 ? 0 : e[n - 1]));
+  ends.assign(e, e + n);
+  consistent.resize(n);
+  for (uint32_t id = 0; id < n; id++)
+  {
+    bool ok = true;
+    for (const Lit* li = begin(id); ok && li + 1 < end(id); li++)
+      ok = var(li[0]) != var(li[1]);
+    consistent[id] = ok;
+  }
+  ids.clear();
+}
+
+bool AnnotationTable::contains(uint32_t id, Lit l) const
+{
+  return std::binary_search(begin(id), end(id), l, lit_order);
+}
+
+bool AnnotationTable::compatible(uint32_t a, uint32_t b, CompatibleCache& cache) const
+{
+  if (!consistent[a] || !consistent[b]) return false;
+  if (a == b || a == 0 || b == 0) return true;
+  if (a > b) std::swap(a, b);
+
+  uint64_t key = (uint64_t)a << 32 | b;
+  auto cached = cache.find(key);
+  if (cached != cache.end()) return cached->second;
+
+  bool ok = true;
+  const Lit* li1 = begin(a);
+  const Lit* li2 = begin(b);
+  while (ok && li1 != end(a) && li2 != end(b))
+  {
+    if (var(*li1) < var(*li2)) li1++;
+    else if (var(*li1) > var(*li2)) li2++;
+    else
+    {
+      ok = *li1 == *li2;
+      li1++, li2++;
+    }
+  }
+  cache.emplace(key, ok);
+  return ok;
+}
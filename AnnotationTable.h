@@ -0,0 +1,59 @@
+//
+// Interned annotations of expansion variables
+//
+
+#ifndef FERPCHECK_ANNOTATIONTABLE_H
+#define FERPCHECK_ANNOTATIONTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+
+/// Hash-consed table of annotations, i.e. assignments to universal variables
+/** Every distinct annotation is stored once, sorted by lit_order and without
+ * duplicate literals, and identified by a 32-bit id in order of first
+ * appearance. Id 0 is the empty annotation.
+ */
+class AnnotationTable
+{
+  std::vector<Lit> lits;                          ///< Literals of all annotations
+  std::vector<uint32_t> ends;                     ///< End of each annotation in #lits
+  std::vector<bool> consistent;                   ///< Whether an annotation assigns no variable both ways
+  std::unordered_multimap<uint64_t, uint32_t> ids; ///< Ids of the annotations with a given hash, all but assigned ones
+
+  static uint64_t hash(const Lit* begin, const Lit* end);
+  bool equals(uint32_t id, const Lit* begin, const Lit* end) const;
+public:
+  /// Results of compatible(), keyed by the pair of ids
+  typedef std::unordered_map<uint64_t, bool> CompatibleCache;
+  
+  AnnotationTable();
+
+  /// Returns the id of \a anno, which is added to the table if it is new
+  uint32_t intern(const std::vector<Lit>& anno);
+
+  /// Replaces the table by \a n annotations, stored as by begin() and end() with end offsets \a e into \a l
+  /** Annotation 0 has to be the empty one and all of them sorted and distinct, as
+   * in a table written to a snapshot. They are only hashed on the next intern().
+   */
+  void assign(const Lit* l, const uint64_t* e, uint32_t n);
+
+  const Lit* begin(uint32_t id) const { return lits.data() + (id == 0 ? 0 : ends[id - 1]); }
+  const Lit* end(uint32_t id) const { return lits.data() + ends[id]; }
+
+  /// Returns true if annotation \a id contains \a l
+  bool contains(uint32_t id, Lit l) const;
+
+  /// Returns true if annotations \a a and \a b do not assign a variable in different ways
+  /** Results are remembered in \a cache, the table itself is not modified so
+   * several threads can use it with a cache each. compatible(a, a) tells
+   * whether \a a is consistent on its own.
+   */
+  bool compatible(uint32_t a, uint32_t b, CompatibleCache& cache) const;
+
+  uint32_t size() const { return (uint32_t)ends.size(); }
+};
+
+#endif //FERPCHECK_ANNOTATIONTABLE_H
@@ -0,0 +1,75 @@
+//
+// Set of literals assigned while checking a nor clause
+//
+
+#ifndef FERPCHECK_ASSIGNMENT_H
+#define FERPCHECK_ASSIGNMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "common.h"
+
+/// Literals in order of insertion with constant time insertion and lookup
+/** Every literal added since the last clear() is stamped with the current epoch
+ * in a table indexed by literal, so clear() does not touch the table and it is
+ * reused from one nor clause to the next.
+ */
+class Assignment
+{
+  std::vector<uint32_t> stamps; ///< Epoch in which a literal was added, indexed by index()
+  std::vector<Lit> lits;        ///< Literals in order of insertion
+  uint32_t epoch;               ///< Stamp of the literals added since the last clear()
+  bool conflict;                ///< Whether a literal and its negation have been added
+
+  static size_t index(Lit l) { return 2 * (size_t)var(l) + sign(l); }
+public:
+  Assignment() : epoch(1), conflict(false) {}
+
+  /// Adds \a l, returns false if it is already present
+  inline bool insert(Lit l);
+
+  bool contains(Lit l) const
+  {
+    const size_t i = index(l);
+    return i < stamps.size() && stamps[i] == epoch;
+  }
+
+  /// Returns true if some literal has been added in both polarities
+  bool conflicting() const { return conflict; }
+
+  const Lit* begin() const { return lits.data(); }
+  const Lit* end() const { return lits.data() + lits.size(); }
+  size_t size() const { return lits.size(); }
+
+  /// Removes all literals, the table is kept
+  inline void clear();
+};
+
+//////////// INLINE IMPLEMENTATIONS ////////////
+
+inline bool Assignment::insert(Lit l)
+{
+  const size_t i = index(l);
+  if (i >= stamps.size()) stamps.resize(std::max(i + 2, 2 * stamps.size()), 0);
+  if (stamps[i] == epoch) return false;
+  stamps[i] = epoch;
+  lits.push_back(l);
+  conflict |= contains(negate(l));
+  return true;
+}
+
+inline void Assignment::clear()
+{
+  lits.clear();
+  conflict = false;
+  if (++epoch == 0)
+  {
+    // stamps of earlier epochs would become current again
+    std::fill(stamps.begin(), stamps.end(), 0);
+    epoch = 1;
+  }
+}
+
+#endif //FERPCHECK_ASSIGNMENT_H
@@ -8,11 +8,14 @@
 
 Clause* Clause::make_clause(std::vector<Lit>& exi, std::vector<Lit>& uni)
 {
-  unsigned int bytes = sizeof (Clause) + (exi.size() + uni.size() - 2) * sizeof (Lit);
-  assert(bytes % sizeof(int) == 0);
-  int* ptr = new int[bytes / sizeof(int)];
+  int* ptr = new int[words(exi.size() + uni.size())];
   assert(((size_t)ptr & 0x3UL) == 0x0UL);
-  Clause* clause = (Clause*) ptr;
+  return place_clause(ptr, exi, uni);
+}
+
+Clause* Clause::place_clause(int* mem, const std::vector<Lit>& exi, const std::vector<Lit>& uni)
+{
+  Clause* clause = (Clause*) mem;
   
   clause->size_a = (unsigned int)uni.size();
   clause->size_e = (unsigned int)exi.size();
@@ -21,6 +21,13 @@ struct Clause
   /// Constructs a clause from a existential and universal literal vectors \a exi and \a uni
   static Clause* make_clause(std::vector<Lit>& exi, std::vector<Lit>& uni);
   
+  /// Constructs a clause like make_clause(std::vector<Lit>&, std::vector<Lit>&) in the words at \a mem
+  /** \a mem has to hold words(exi.size() + uni.size()) words. */
+  static Clause* place_clause(int* mem, const std::vector<Lit>& exi, const std::vector<Lit>& uni);
+  
+  /// Number of words occupied by a clause with \a size literals
+  static inline size_t words(size_t size) {return sizeof (Clause) / sizeof (int) + size - 2;}
+  
   /// Destroys a clause and deallocates memory
   static void destroy_clause(Clause* clause);
   
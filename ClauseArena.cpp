@@ -0,0 +1,55 @@
+//
+// Block storage for the clauses of a trace
+//
+
+#include "ClauseArena.h"
+
+#include <string.h>
+#include <algorithm>
+
+const size_t ClauseArena::block_size;
+
+Lit* ClauseArena::add(const Lit* lits, size_t n)
+{
+  if (blocks.empty() || used + n > capacity)
+  {
+    // the previous block is complete, it may already be unused
+    if (!blocks.empty() && live.back() == 0) blocks.back().reset();
+    capacity = std::max(block_size, n);
+    blocks.emplace_back(new Lit[capacity]);
+    block_first.push_back((uint32_t)starts.size());
+    live.push_back(0);
+    used = 0;
+  }
+
+  Lit* start = blocks.back().get() + used;
+  if (n != 0) memcpy(start, lits, n * sizeof(Lit));
+  used += n;
+  num_lits += n;
+  live.back()++;
+  starts.push_back(start);
+  sizes.push_back((uint32_t)n);
+  return start;
+}
+
+void ClauseArena::release(uint32_t i)
+{
+  if (starts[i] == nullptr) return;
+  starts[i] = nullptr;
+
+  // blocks hold consecutive clauses
+  size_t b = std::upper_bound(block_first.begin(), block_first.end(), i) - block_first.begin() - 1;
+  if (--live[b] == 0 && b + 1 < blocks.size()) blocks[b].reset();
+}
+
+void ClauseArena::clear()
+{
+  starts.clear();
+  sizes.clear();
+  blocks.clear();
+  block_first.clear();
+  live.clear();
+  used = 0;
+  capacity = 0;
+  num_lits = 0;
+}
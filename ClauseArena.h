@@ -0,0 +1,65 @@
+//
+// Block storage for the clauses of a trace
+//
+
+#ifndef FERPCHECK_CLAUSEARENA_H
+#define FERPCHECK_CLAUSEARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "common.h"
+
+/// Literals of a clause stored in a ClauseArena, valid until the clause is released
+struct ClauseRef
+{
+  const Lit* lits;
+  uint32_t num_lits;
+
+  const Lit* begin() const { return lits; }
+  const Lit* end() const { return lits + num_lits; }
+  size_t size() const { return num_lits; }
+  bool empty() const { return num_lits == 0; }
+  Lit operator[](size_t i) const { return lits[i]; }
+};
+
+/// Stores the literals of clauses one after the other in large blocks
+/** Clauses are appended and addressed by their index. Appending does not
+ * allocate per clause, a block is allocated every #block_size literals. Released
+ * clauses stay addressable, but their literals must not be accessed any more. A
+ * block is freed as soon as all of its clauses are released.
+ */
+class ClauseArena
+{
+  static const size_t block_size = 1 << 20; ///< Literals per block, larger clauses get a block of their own
+
+  std::vector<Lit*> starts;                    ///< First literal of each clause, nullptr once released
+  std::vector<uint32_t> sizes;                 ///< Number of literals of each clause
+  std::vector<std::unique_ptr<Lit[]>> blocks;  ///< Blocks, nullptr once freed
+  std::vector<uint32_t> block_first;           ///< Index of the first clause of each block
+  std::vector<uint32_t> live;                  ///< Number of clauses of each block that are not released
+  size_t used;                                 ///< Literals used in the last block
+  size_t capacity;                             ///< Literals available in the last block
+  uint64_t num_lits;                           ///< Literals of all clauses, including released ones
+public:
+  ClauseArena() : used(0), capacity(0), num_lits(0) {}
+
+  /// Appends a copy of \a n literals at \a lits, returns the stored literals
+  Lit* add(const Lit* lits, size_t n);
+
+  /// Returns clause \a i
+  ClauseRef operator[](uint32_t i) const { return {starts[i], sizes[i]}; }
+
+  bool released(uint32_t i) const { return starts[i] == nullptr; }
+
+  /// Releases clause \a i, freeing its block if no other clause of it is left
+  void release(uint32_t i);
+
+  uint32_t size() const { return (uint32_t)starts.size(); }
+  uint64_t numLits() const { return num_lits; }
+
+  void clear();
+};
+
+#endif //FERPCHECK_CLAUSEARENA_H
@@ -5,22 +5,35 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include "ipasir.hh"
 #include <sys/resource.h>
 #include "FerpManager.h"
+#include "InputSource.h"
+#include "Parallel.h"
+#ifdef FERP_TRIM
+#include "FerpWriter.h"
+#endif
 
 #define DEBUG 0
 #define debugf(fmt, ...) \
             do { if (DEBUG) fprintf(stderr, fmt, __VA_ARGS__); } while (0)
 
 
-// taken from qrpcheck
+// taken from qrpcheck, times of checks running on several threads are added up per thread
 static inline double read_cpu_time()
 {
   struct rusage u;
+#ifdef RUSAGE_THREAD
+  if (getrusage (RUSAGE_THREAD, &u))
+#else
   if (getrusage (RUSAGE_SELF, &u))
+#endif
     return 0;
   return u.ru_utime.tv_sec + 1e-6 * u.ru_utime.tv_usec +
          u.ru_stime.tv_sec + 1e-6 * u.ru_stime.tv_usec;
@@ -28,30 +41,8 @@ static inline double read_cpu_time()
 
 FerpManager::~FerpManager()
 {
-  for(std::vector<Lit>* a : annotations)
-    delete a;
-  for(std::vector<Lit>* c : trace_clauses)
-    delete c;
-  for(std::array<uint32_t, 2>* a : antecedents)
-    delete a;
 
-  for (auto& outer_vec : original_clause_mapping) {
-      for (auto& inner_vec : *outer_vec) {
-          delete inner_vec;
-      }
-      delete outer_vec;
-  }
-  original_clause_mapping.clear();
-
-  for (auto& outer_vec : nor_clauses) {
-      delete outer_vec;
-  }
-  nor_clauses.clear();
-
-  for (auto& pair : helper_variable_mapping) {
-      delete pair.second;
-  }
-  helper_variable_mapping.clear();
+  delete snapshot;
 
 #ifdef FERP_CERT
   if(aig != nullptr) delete aig;
@@ -60,53 +51,136 @@ FerpManager::~FerpManager()
 
 int FerpManager::addVariables(const std::vector<Var>& prop, const std::vector<Var>& orig, const std::vector<Lit>& anno)
 {
-  std::vector<Lit>* anno_ptr = new std::vector<Lit>(anno);
-  annotations.push_back(anno_ptr);
+  uint32_t anno_id = annotations.intern(anno);
   
   bool success = true;
   for(uint32_t i = 0; success && i < prop.size(); i++)
-    success &= prop_to_original.insert(std::pair<Var, Var>(prop[i], orig[i])).second;
-  
-  if(!success) return 1;
+    success &= addExpansionVariable(prop[i], orig[i], anno_id);
   
-  for(uint32_t i = 0; i < prop.size(); i++)
-    prop_to_annotation.insert(std::pair<Var, std::vector<Lit>*>(prop[i], anno_ptr));
-  
-  return 0;
+  return success ? 0 : 1;
+}
+
+bool FerpManager::addExpansionVariable(Var prop, Var orig, uint32_t anno_id)
+{
+  if (!prop_to_original.insert(prop, orig)) return false;
+  prop_to_annotation.insert(prop, anno_id);
+  var_kinds.insert(prop, VAR_EXPANSION);
+  return true;
 }
 
-int FerpManager::addClause(uint32_t id, std::vector<Lit>* clause, std::array<uint32_t, 2>* ante)
+int FerpManager::addClause(uint32_t id, const Lit* lits, size_t num_lits, const std::array<uint32_t, 2>& ante)
 {
-  if (!cnf_id_to_trace_id.insert(std::pair<uint32_t, uint32_t>(id, trace_clauses.size())).second) return 1;
+  if (!cnf_id_to_trace_id.insert(id, trace_clauses.size())) return 1;
   trace_id_to_cnf_id.push_back(id);
   
   if (!is_sat) {
-    for(const Lit l : *clause)
-      if(prop_to_original.find(var(l)) == prop_to_original.end()) return 2;
+    for(size_t i = 0; i < num_lits; i++)
+      if(!isExpansion(var(lits[i]))) return 2;
   }
 
-  if(root != 0 && clause->empty()) return 3;
+  if(root != 0 && num_lits == 0) return 3;
   
-  if(clause->empty())
-    root = (uint32_t)trace_clauses.size();
+  if(num_lits == 0)
+    root = trace_clauses.size();
   
-  std::sort(clause->begin(), clause->end(), lit_order);
-  trace_clauses.push_back(clause);
+  Lit* clause = trace_clauses.add(lits, num_lits);
+  std::sort(clause, clause + num_lits, lit_order);
   antecedents.push_back(ante);
   
+#ifdef FERP_CHECK
+  if (online_qbf != nullptr && !is_sat && id != 0)
+  {
+    // the clause is stored anyway, the reader stops at the first failure
+    online_result = checkAdded((uint32_t)trace_clauses.size() - 1);
+  }
+#endif
+  
+  return 0;
+}
+
+int FerpManager::deleteClause(uint32_t id)
+{
+  if (id == 0 || !cnf_id_to_trace_id.contains(id)) return 1;
+  
+#ifdef FERP_CHECK
+  if (online_qbf != nullptr && !is_sat)
+  {
+    // steps waiting for another antecedent may still refer to the clause
+    deferred.push_back(id);
+    if (waiting.empty()) releaseDeferred();
+  }
+#endif
   return 0;
 }
 
-bool FerpManager::isHelper(Var v)
+void FerpManager::markReachable(std::vector<bool>& mark)
 {
-  for (const auto &pair : prop_to_original)
+  mark.assign(trace_clauses.size(), false);
+  std::vector<uint32_t> queue;
+  queue.push_back(root);
+  mark[root] = true;
+  
+  // todo: cycle detection
+  
+  while(!queue.empty())
   {
-    auto key = pair.first;
-    if (v == key) {
-      return false;
+    uint32_t node = queue.back();
+    queue.pop_back();
+    
+    uint32_t next = antecedents[node][1];
+    if(next == 0) continue;
+    if (!resolved_antecedents) next = cnf_id_to_trace_id.get(next);
+    if(!mark[next])
+    {
+      mark[next] = true;
+      queue.push_back(next);
+    }
+    
+    next = antecedents[node][0];
+    if (!resolved_antecedents) next = cnf_id_to_trace_id.get(next);
+    
+    if(!mark[next])
+    {
+      mark[next] = true;
+      queue.push_back(next);
     }
   }
-  return true;
+}
+
+void FerpManager::addHelperLits(Var helper, const Lit* lits, size_t num_lits)
+{
+  if (var_kinds.insert(helper, VAR_HELPER))
+    helper_rows.insert(helper, (uint32_t)helper_rows.size());
+  const uint32_t row = helper_rows.get(helper);
+  for (size_t i = 0; i < num_lits; i++)
+    helper_pending.push_back(std::make_pair(row, lits[i]));
+}
+
+void FerpManager::finaliseHelpers()
+{
+  if (helper_pending.empty()) return;
+  
+  // counting sort by row, literals of a row stay in the order they were added
+  const uint32_t num_rows = (uint32_t)helper_rows.size();
+  std::vector<uint32_t> offsets(num_rows + 1, 0);
+  for (uint32_t r = 0; r + 1 < helper_offsets.size(); r++)
+    offsets[r + 1] = helper_offsets[r + 1] - helper_offsets[r];
+  for (const auto& p : helper_pending)
+    offsets[p.first + 1]++;
+  for (uint32_t r = 0; r < num_rows; r++)
+    offsets[r + 1] += offsets[r];
+  
+  std::vector<Lit> lits(offsets[num_rows]);
+  std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+  for (uint32_t r = 0; r + 1 < helper_offsets.size(); r++)
+    for (uint32_t i = helper_offsets[r]; i < helper_offsets[r + 1]; i++)
+      lits[fill[r]++] = helper_lits[i];
+  for (const auto& p : helper_pending)
+    lits[fill[p.first]++] = p.second;
+  
+  helper_offsets.swap(offsets);
+  helper_lits.swap(lits);
+  std::vector<std::pair<uint32_t, Lit>>().swap(helper_pending);
 }
 
 #ifdef FERP_CHECK
@@ -129,20 +203,55 @@ int FerpManager::checkSAT(const Formula& qbf)
   find_assignment_time = 0;
   eliminate_clauses_time = 0;
 
-  uint32_t origin_idx = 0;
-  for (auto clause : nor_clauses)
+  scratch = Scratch();
+  if (threads <= 1)
   {
-    // clause comes from axiom rule
-    int res = checkExpansionSAT(qbf, clause, origin_idx);
+    // clauses come from axiom rule
+    int res = 0;
+    for (uint32_t i = 0; res == 0 && i < nor_clauses.size(); i++)
+      res = checkExpansionSAT(qbf, i, scratch);
+    if (res) printConflict(scratch);
+    finishScratch(scratch);
     if (res) return res;
-    origin_idx += 1;
+  }
+  else
+  {
+    // threads take the next nor clause, each with solvers of its own
+    std::vector<Scratch> scratches(threads);
+    std::atomic<uint32_t> next(0);
+    std::atomic<uint32_t> first_failed((uint32_t)nor_clauses.size());
+    std::vector<int> results(nor_clauses.size(), 0);
+    std::vector<uint32_t> failed_at(threads, UINT32_MAX); // a thread stops at its first failed clause
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+      workers.emplace_back([&, t]()
+      {
+        // clauses after a failed one need not be checked
+        for (uint32_t i = next++; i < first_failed; i = next++)
+        {
+          results[i] = checkExpansionSAT(qbf, i, scratches[t]);
+          if (results[i] == 0) continue;
+          failed_at[t] = i;
+          uint32_t failed = first_failed;
+          while (i < failed && !first_failed.compare_exchange_weak(failed, i)) {}
+        }
+      });
+    for (std::thread& w : workers)
+      w.join();
+    
+    for (unsigned t = 0; t < threads; t++)
+    {
+      if (failed_at[t] == first_failed) printConflict(scratches[t]);
+      finishScratch(scratches[t]);
+    }
+    if (first_failed < nor_clauses.size()) return results[first_failed];
   }
 
   double start_check_resolution = read_cpu_time();
   for (auto i : res_clause_ids)
   {
     // clause comes from res rule
-    int res = checkResolution(i);
+    int res = checkResolution(i, cnf_id_to_trace_id.get(antecedents[i][0]), cnf_id_to_trace_id.get(antecedents[i][1]));
     if (res) return res;
   }
   check_resolution_time = read_cpu_time() - start_check_resolution;
@@ -150,235 +259,487 @@ int FerpManager::checkSAT(const Formula& qbf)
   return 0;
 }
 
+void* FerpManager::initIncrementalSolver(const Formula& qbf)
+{
+  // existential part of every clause, switched off unless its activation literal is assumed
+  void* sat_solver = ipasir_init();
+  for (unsigned i = 0; i < qbf.numClauses(); i++) {
+    const Clause* qbf_clause = qbf.getClause(i);
+    ipasir_add(sat_solver, negate(activationLit(qbf, i)));
+    for (auto ex_it = qbf_clause->begin_e(); ex_it < qbf_clause->end_e(); ex_it++) {
+      ipasir_add(sat_solver, *ex_it);
+    }
+    ipasir_add(sat_solver, 0);
+  }
+  return sat_solver;
+}
+
+void FerpManager::finishScratch(Scratch& s)
+{
+  addTimes(s);
+  if (s.solver != nullptr) ipasir_release(s.solver);
+  s.solver = nullptr;
+}
+
+void FerpManager::printConflict(const Scratch& s)
+{
+  for (const uint32_t i : s.conflict_clauses)
+    printf("Conflicting clause %u\n", i + 1);
+  for (const Lit lit : s.conflict_assignment)
+    printf("Conflicting assignment %d\n", lit);
+}
+
+void FerpManager::addTimes(const Scratch& s)
+{
+  sat_calls += s.sat_calls;
+  check_nor_time += s.check_nor_time;
+  check_elimination_time += s.check_elimination_time;
+  check_sat_time += s.check_sat_time;
+  find_assignment_time += s.find_assignment_time;
+  eliminate_clauses_time += s.eliminate_clauses_time;
+}
+
+int FerpManager::checkAdded(uint32_t index)
+{
+  int res = checkIfReady(index);
+  if (res) return res;
+  
+  // resolution steps that were waiting for this clause
+  auto range = waiting.equal_range(trace_id_to_cnf_id[index]);
+  std::vector<uint32_t> ready;
+  for (auto it = range.first; it != range.second; it++)
+    ready.push_back(it->second);
+  waiting.erase(range.first, range.second);
+  
+  for (uint32_t i : ready)
+  {
+    res = checkIfReady(i);
+    if (res) return res;
+  }
+  
+  if (waiting.empty() && !deferred.empty()) releaseDeferred();
+  return 0;
+}
+
+void FerpManager::releaseDeferred()
+{
+  for (const uint32_t id : deferred)
+  {
+    uint32_t index;
+    if (!cnf_id_to_trace_id.find(id, index)) continue;
+    trace_clauses.release(index);
+    cnf_id_to_trace_id.erase(id);
+  }
+  deferred.clear();
+}
+
+int FerpManager::checkIfReady(uint32_t index)
+{
+  const std::array<uint32_t, 2>& ante = antecedents[index];
+  if (ante[1] == 0) return checkExpansionUNSAT(*online_qbf, index, scratch);
+  
+  std::array<uint32_t, 2> parents;
+  for (int i = 0; i < 2; i++)
+  {
+    if (!cnf_id_to_trace_id.find(ante[i], parents[i]))
+    {
+      waiting.insert(std::pair<uint32_t, uint32_t>(ante[i], index));
+      return 0;
+    }
+  }
+  
+  // ids of deleted clauses are released, checked steps keep their antecedents as trace indices
+  antecedents[index] = parents;
+  return checkResolution(index, parents[0], parents[1]);
+}
+
 int FerpManager::checkUNSAT(const Formula& qbf)
 {
+  if (online_qbf != nullptr)
+  {
+    // antecedents of the remaining steps never appeared, they are checked like after reading
+    std::vector<uint32_t> left;
+    for (const auto& w : waiting)
+      left.push_back(w.second);
+    waiting.clear();
+    std::sort(left.begin(), left.end());
+    for (uint32_t i : left)
+    {
+      std::array<uint32_t, 2>& ante = antecedents[i];
+      ante = {cnf_id_to_trace_id.get(ante[0]), cnf_id_to_trace_id.get(ante[1])};
+      int res = checkResolution(i, ante[0], ante[1]);
+      if (res) return res;
+    }
+    return checkRedundant();
+  }
+  
+  // in backward mode only the clauses the root depends on are checked
+  std::vector<bool> core;
+  if (backward)
+  {
+    if(root == 0) return 13;
+    markReachable(core);
+  }
+  
+  // clauses are released after their last use as an antecedent
+  std::vector<std::array<uint32_t, 2>> parents(trace_clauses.size(), {0, 0});
+  std::vector<uint32_t> last_use(trace_clauses.size(), 0);
   for(uint32_t i = 1; i < trace_clauses.size(); i++)
   {
-    if(antecedents[i]->at(1) == 0)
+    if(antecedents[i][1] == 0 || (backward && !core[i])) continue;
+    parents[i] = {cnf_id_to_trace_id.get(antecedents[i][0]), cnf_id_to_trace_id.get(antecedents[i][1])};
+    for (const uint32_t p : parents[i])
+      last_use[p] = std::max(last_use[p], i);
+  }
+  
+  auto checkStep = [&](uint32_t i, Scratch& s)
+  {
+    if (backward && !core[i]) return 0;
+    if(antecedents[i][1] == 0)
     {
       // clause comes from axiom rule
-      int res = checkExpansionUNSAT(qbf, i);
-      if (res) return res;
+      return checkExpansionUNSAT(qbf, i, s);
     }
-    else
+    // clause comes from res rule
+    return checkResolution(i, parents[i][0], parents[i][1]);
+  };
+  
+  auto releaseStep = [&](uint32_t i)
+  {
+    if (backward && !core[i])
     {
-      // clause comes from res rule
-      int res = checkResolution(i);
+      // no step of the core uses the clause
+      skipped_steps++;
+      trace_clauses.release(i);
+      return;
+    }
+    
+    // parents after i are released once they are checked themselves
+    if (last_use[i] <= i)
+      trace_clauses.release(i);
+    for (const uint32_t p : parents[i])
+    {
+      if (p != 0 && p < i && last_use[p] == i)
+        trace_clauses.release(p);
+    }
+  };
+  
+  if (threads <= 1)
+  {
+    for(uint32_t i = 1; i < trace_clauses.size(); i++)
+    {
+      int res = checkStep(i, scratch);
       if (res) return res;
+      releaseStep(i);
     }
   }
+  else
+  {
+    // rounds of consecutive slices, one per thread, clauses are only released between rounds.
+    // The workers are started once and wait for the next round after their slice.
+    const uint32_t slice_size = (uint32_t)splitSize(1 << 14);
+    const uint32_t num_steps = trace_clauses.size();
+    std::vector<Scratch> scratches(threads);
+    std::vector<int> results(threads, 0);
+    std::mutex mutex;
+    std::condition_variable round_started, round_done;
+    uint64_t rounds = 0;      // rounds started so far
+    uint32_t round_first = 1; // first step of the current round
+    unsigned busy = 0;        // workers still checking their slice of the current round
+    bool stop = false;
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+      workers.emplace_back([&, t]()
+      {
+        for (uint64_t round = 1;; round++)
+        {
+          uint32_t begin, end;
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            round_started.wait(lock, [&]() { return stop || rounds == round; });
+            if (stop) return;
+            begin = (uint32_t)std::min<uint64_t>(round_first + (uint64_t)t * slice_size, num_steps);
+            end = (uint32_t)std::min<uint64_t>((uint64_t)begin + slice_size, num_steps);
+          }
+          int res = 0;
+          for (uint32_t i = begin; res == 0 && i < end; i++)
+            res = checkStep(i, scratches[t]);
+          
+          std::lock_guard<std::mutex> lock(mutex);
+          results[t] = res;
+          if (--busy == 0) round_done.notify_one();
+        }
+      });
+    
+    int res = 0;
+    for(uint32_t first = 1; res == 0 && first < num_steps; first += threads * slice_size)
+    {
+      const uint32_t last = (uint32_t)std::min<uint64_t>(first + (uint64_t)threads * slice_size, num_steps);
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        round_first = first;
+        busy = threads;
+        rounds++;
+        round_started.notify_all();
+        round_done.wait(lock, [&]() { return busy == 0; });
+      }
+      
+      // earlier slices hold earlier steps
+      for (uint32_t t = 0; res == 0 && t < threads; t++)
+        res = results[t];
+      for (uint32_t i = first; res == 0 && i < last; i++)
+        releaseStep(i);
+    }
+    
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    round_started.notify_all();
+    for (std::thread& w : workers)
+      w.join();
+    if (res) return res;
+  }
   
-  // check whether every clause is reachable
+  // check whether every clause is reachable, skipped ones are not by construction
+  if (backward) return 0;
   int res = checkRedundant();
   if (res) return res;
   
   return 0;
 }
 
-int FerpManager::checkExpansionUNSAT(const Formula& qbf, uint32_t index)
+int FerpManager::checkExpansionUNSAT(const Formula& qbf, uint32_t index, Scratch& s)
 {
   // check if original id exists and existential part size
-  const std::vector<Lit>* prop_clause = trace_clauses[index];
-  uint32_t orig_id = antecedents[index]->at(0) - 1;
+  const ClauseRef prop_clause = trace_clauses[index];
+  uint32_t orig_id = antecedents[index][0] - 1;
   if(orig_id >= qbf.numClauses()) return 1;
   const Clause* qbf_clause = qbf.getClause(orig_id);
-  if(qbf_clause->size_e != prop_clause->size()) return 2;
+  if(qbf_clause->size_e != prop_clause.size()) return 2;
   
   // generate existential part of original clause
-  orig_ex.clear();
-  for(const Lit l : *prop_clause)
-    orig_ex.push_back(make_lit(prop_to_original[var(l)], sign(l)));
-  std::sort(orig_ex.begin(), orig_ex.end(), lit_order);
+  s.orig_ex.clear();
+  for(const Lit l : prop_clause)
+    s.orig_ex.push_back(make_lit(prop_to_original.get(var(l)), sign(l)));
+  std::sort(s.orig_ex.begin(), s.orig_ex.end(), lit_order);
   
   // check if clauses are the same
   {
     const_lit_iterator li1 = qbf_clause->begin_e();
-    auto li2 = orig_ex.begin();
-    for(; li1 < qbf_clause->end_e() && li2 != orig_ex.end(); li1++, li2++)
+    auto li2 = s.orig_ex.begin();
+    for(; li1 < qbf_clause->end_e() && li2 != s.orig_ex.end(); li1++, li2++)
       if(*li1 != *li2) return 3;
   }
   
-  // todo: can be implemented much more efficiently
   // collect annotations of clause
-  std::set<std::vector<Lit>*> added_anots;
-  for(auto li = prop_clause->begin(); li != prop_clause->end(); li++)
-    added_anots.insert(prop_to_annotation[var(*li)]);
+  s.clause_annos.clear();
+  for(auto li = prop_clause.begin(); li != prop_clause.end(); li++)
+    s.clause_annos.push_back(prop_to_annotation.get(var(*li)));
+  std::sort(s.clause_annos.begin(), s.clause_annos.end());
+  s.clause_annos.erase(std::unique(s.clause_annos.begin(), s.clause_annos.end()), s.clause_annos.end());
   
-  std::set<Lit> clause_anot;
-  for(const std::vector<Lit>* a : added_anots)
-    for(const Lit l : *a)
-    {
-      if(clause_anot.find(negate(l)) != clause_anot.end()) return 4;
-      clause_anot.insert(l);
-    }
+  // annotations have to agree on every universal variable
+  for(size_t i = 0; i < s.clause_annos.size(); i++)
+    for(size_t j = i; j < s.clause_annos.size(); j++)
+      if(!annotations.compatible(s.clause_annos[i], s.clause_annos[j], s.compatible_cache)) return 4;
   
   // check if the negated universals are in clause annotation
   for(const_lit_iterator li = qbf_clause->begin_a(); li < qbf_clause->end_a(); li++)
-    if(clause_anot.find(negate(*li)) == clause_anot.end()) return 5;
+  {
+    bool found = false;
+    for(size_t i = 0; !found && i < s.clause_annos.size(); i++)
+      found = annotations.contains(s.clause_annos[i], negate(*li));
+    if(!found) return 5;
+  }
   
   return 0;
 }
 
-int FerpManager::checkExpansionSAT(const Formula& qbf, std::vector<Lit>* prop_clause, uint32_t origin_idx)
+int FerpManager::checkExpansionSAT(const Formula& qbf, uint32_t index, Scratch& s)
 {
   
   double start_check_nor_clause = read_cpu_time();
 
-  std::vector<Lit> assignment;
+  Assignment& assignment = s.assignment;
+  assignment.clear();
   
-  // const std::vector<Lit>* prop_clause = trace_clauses[index];
-  auto orignal_clauses = original_clause_mapping[origin_idx];
-  assert(prop_clause->size() == orignal_clauses->size());
-
-  auto it1 = prop_clause->begin();
-  auto it2 = orignal_clauses->begin();
-  auto end1 = prop_clause->end();
-  auto end2 = orignal_clauses->end();
-
-  while (it1 != end1 && it2 != end2) {
-    auto lit = *it1;
-    auto origin_arr = *it2;
+  // literal k of the nor clause has the original clauses in list beginOffset(index) + k
+  assert(nor_originals.size() == nor_clauses.numValues());
+  for (uint64_t k = nor_clauses.beginOffset(index); k < nor_clauses.endOffset(index); k++) {
+    const Lit lit = nor_clauses.valuesData()[k];
 
     // create literal array, if helper variable
     std::vector<Lit> literal_array;
     if (isHelper(var(lit))) {
       assert(sign(lit));
-      for (auto l : *helper_variable_mapping[var(lit)]) {
-        literal_array.push_back(l);
-      }
+      const uint32_t row = helper_rows.get(var(lit));
+      literal_array.assign(helper_lits.begin() + helper_offsets[row], helper_lits.begin() + helper_offsets[row + 1]);
     } else {
       literal_array.push_back(lit);
     }
 
-    orig_ex.clear();    
+    s.orig_ex.clear();    
     for (auto litt : literal_array) {      
-      for (auto annotation : *prop_to_annotation[var(litt)]) {
-        if (std::find(assignment.begin(), assignment.end(), annotation) == assignment.end()) {
-          assignment.push_back(annotation);
-        }
+      const uint32_t anno = prop_to_annotation.get(var(litt));
+      for (const Lit* ai = annotations.begin(anno); ai != annotations.end(anno); ai++) {
+        const Lit annotation = *ai;
+        assignment.insert(annotation);
       }      
-      orig_ex.push_back(make_lit(prop_to_original[var(litt)], sign(litt)));      
+      s.orig_ex.push_back(make_lit(prop_to_original.get(var(litt)), sign(litt)));      
     }
-    std::sort(orig_ex.begin(), orig_ex.end(), lit_order);
+    std::sort(s.orig_ex.begin(), s.orig_ex.end(), lit_order);
 
-    for (auto origin : *origin_arr) {
-      const Clause* qbf_clause = qbf.getClause(origin - 1);
+    for (const uint32_t* oi = nor_originals.begin(k); oi != nor_originals.end(k); oi++) {
+      const Clause* qbf_clause = qbf.getClause(*oi - 1);
       if(qbf_clause->size_a != literal_array.size()) return 2;
 
       // check if clauses are negated
       {
         const_lit_iterator li1 = qbf_clause->begin_a();
-        auto li2 = orig_ex.begin();
-        for(; li1 < qbf_clause->end_a() && li2 != orig_ex.end(); li1++, li2++)
+        auto li2 = s.orig_ex.begin();
+        for(; li1 < qbf_clause->end_a() && li2 != s.orig_ex.end(); li1++, li2++)
           if(*li1 != -(*li2)) return 3;
       }
       
       // add all existentials negated to current assignment
       {
         for (auto ex_it = qbf_clause->begin_e(); ex_it < qbf_clause->end_e(); ex_it++) {
-          if (std::find(assignment.begin(), assignment.end(), negate(*ex_it)) == assignment.end()) {
-            assignment.push_back(negate(*ex_it));
-          }
+          assignment.insert(negate(*ex_it));
         }
       }
     }
-    it1 += 1;
-    it2 += 1;
   }
-  check_nor_time += read_cpu_time() - start_check_nor_clause;
+  s.check_nor_time += read_cpu_time() - start_check_nor_clause;
   
   double start_check_elimination = read_cpu_time();
 
-  auto res = checkElimination(qbf, origin_idx, assignment);
+  auto res = checkElimination(qbf, index, assignment, s);
   
-  check_elimination_time += read_cpu_time() - start_check_elimination;
+  s.check_elimination_time += read_cpu_time() - start_check_elimination;
   if (res != 0) return res;
 
   return 0;
 }
 
-int FerpManager::checkElimination(const Formula& qbf, uint32_t origin_idx, std::vector<Lit> assignment)
+int FerpManager::checkElimination(const Formula& qbf, uint32_t origin_idx, Assignment& assignment, Scratch& s)
 {
   double start_find_assignment = read_cpu_time();
 
   // For each clause in \phi not referenced by the nor clause,
-  auto orignal_clauses = original_clause_mapping[origin_idx];
   std::vector<bool> eliminated(qbf.numClauses(), false);
-  for (auto origin_arr : *orignal_clauses) {
-    for (auto original : *origin_arr) {
-      eliminated[original - 1] = true;
+  for (uint64_t k = nor_clauses.beginOffset(origin_idx); k < nor_clauses.endOffset(origin_idx); k++) {
+    for (const uint32_t* oi = nor_originals.begin(k); oi != nor_originals.end(k); oi++) {
+      eliminated[*oi - 1] = true;
     }
   }
   
-  void *sat_solver = ipasir_init();
-  // add the existential part of the clauses that needs to be eliminated
-  for (unsigned i = 0; i < qbf.numClauses(); i++) {        
+  // the assignment already satisfies the clauses it has a literal of
+  if (assignment.conflicting()) {
+    return 102;
+  }
+  for (auto lit : assignment) {
+    for (const uint32_t* ci = qbf.beginOccurrences(lit); ci != qbf.endOccurrences(lit); ci++) {
+      eliminated[*ci] = true;
+    }
+  }
+  
+  // the solver only gets the remaining clauses without their falsified literals
+  s.residual.clear();
+  s.residual_clauses.clear();
+  for (unsigned i = 0; i < qbf.numClauses(); i++) {
     if (eliminated[i]) {
       continue;
     }
     const Clause* qbf_clause = qbf.getClause(i);
+    const size_t begin = s.residual.size();
     for (auto ex_it = qbf_clause->begin_e(); ex_it < qbf_clause->end_e(); ex_it++) {
-      ipasir_add(sat_solver, *ex_it);
+      if (!assignment.contains(negate(*ex_it))) s.residual.push_back(*ex_it);
     }
-    ipasir_add(sat_solver, 0);
+    if (s.residual.size() == begin) {
+      debugf("falsified clause %u\n", i + 1);
+      return 102;
+    }
+    s.residual.push_back(0);
+    s.residual_clauses.push_back(i);
   }
   
-  // add the current assignment
-  for (auto lit : assignment) {
-    ipasir_add(sat_solver, lit);
-    ipasir_add(sat_solver, 0);
-  }
-
-  double start_check_sat_time = read_cpu_time();
+  void *sat_solver = nullptr;
+  if (!s.residual_clauses.empty()) {
+    if (incremental) {
+      // the remaining clauses and the assignment are assumed
+      if (s.solver == nullptr) s.solver = initIncrementalSolver(qbf);
+      sat_solver = s.solver;
+      for (auto i : s.residual_clauses) {
+        ipasir_assume(sat_solver, activationLit(qbf, i));
+      }
+      for (auto lit : assignment) {
+        ipasir_assume(sat_solver, lit);
+      }
+    } else {
+      sat_solver = ipasir_init();
+      for (auto lit : s.residual) {
+        ipasir_add(sat_solver, lit);
+      }
+    }
 
-  auto is_sat = ipasir_solve(sat_solver) == 10;
-  
-  check_sat_time += (read_cpu_time() - start_check_sat_time);
-  sat_calls += 1;
+    double start_check_sat_time = read_cpu_time();
 
-  if (!is_sat) {
-    ipasir_release(sat_solver);
-    return 102;
+    auto is_sat = ipasir_solve(sat_solver) == 10;
+    
+    s.check_sat_time += (read_cpu_time() - start_check_sat_time);
+    s.sat_calls += 1;
+
+    if (!is_sat) {
+      if (incremental) {
+        // the failed assumptions tell which clauses and which part of the assignment conflict,
+        // the caller prints them for the nor clause it reports
+        s.conflict_clauses.clear();
+        s.conflict_assignment.clear();
+        for (auto i : s.residual_clauses) {
+          if (ipasir_failed(sat_solver, activationLit(qbf, i))) s.conflict_clauses.push_back(i);
+        }
+        for (auto lit : assignment) {
+          if (ipasir_failed(sat_solver, lit)) s.conflict_assignment.push_back(lit);
+        }
+      } else {
+        ipasir_release(sat_solver);
+      }
+      return 102;
+    }
   }
 
+  // unassigned existentials take the value of the model, false if there is none
+  const size_t num_assigned = assignment.size();
   for(uint32_t qi = 0; qi < qbf.numQuants(); qi++)
   {
     const Quant* quant = qbf.getQuant(qi);
     if(quant->type == QuantType::EXISTS) {
       for(const_var_iterator vit = quant->begin(); vit != quant->end(); vit++) {
         assert(qbf.isExistential(*vit));
-        Lit lit = ipasir_val(sat_solver, *vit);
-        if (std::find(assignment.begin(), assignment.end(), lit) == assignment.end()) {
-          assignment.push_back(lit);
-        }
+        const Lit lit = make_lit(*vit, false);
+        if (assignment.contains(lit) || assignment.contains(negate(lit))) continue;
+        assignment.insert(sat_solver != nullptr ? ipasir_val(sat_solver, lit) : negate(lit));
       }
     }
   }
-  ipasir_release(sat_solver);
+  if (sat_solver != nullptr && !incremental) ipasir_release(sat_solver);
 
-  find_assignment_time += (read_cpu_time() - start_find_assignment);
+  s.find_assignment_time += (read_cpu_time() - start_find_assignment);
 
 
   double start_eliminate_clauses = read_cpu_time();
 
-  // Check that the assignment array does not contain a literal and its negated literal.
-  for (auto lit : assignment) {
-    if (std::find(assignment.begin(), assignment.end(), negate(lit)) != assignment.end()) {
-      return 101;
-    }
+  // Check that the assignment does not contain a literal and its negated literal.
+  if (assignment.conflicting()) {
+    return 101;
   }
 
-  // check if assignment eliminates the remaining clauses
-  for (unsigned i = 0; i < qbf.numClauses(); i++) {
-    if (eliminated[i]) {
-      continue;
-    }
-    const Clause* qbf_clause = qbf.getClause(i);
-    for (auto lit : assignment) {
-      if (std::find(qbf_clause->begin_e(), qbf_clause->end_e(), lit) != qbf_clause->end_e()) {
-        eliminated[i] = true;
-        break;
-      }
+  // check if the model eliminates the remaining clauses
+  for (auto li = assignment.begin() + num_assigned; li != assignment.end(); li++) {
+    const Lit lit = *li;
+    for (const uint32_t* ci = qbf.beginOccurrences(lit); ci != qbf.endOccurrences(lit); ci++) {
+      eliminated[*ci] = true;
     }
   }
   auto all_eliminated = std::all_of(eliminated.begin(), eliminated.end(), [](bool b) { return b; });
@@ -386,24 +747,24 @@ int FerpManager::checkElimination(const Formula& qbf, uint32_t origin_idx, std::
     return 103;
   }
 
-  eliminate_clauses_time += (read_cpu_time() - start_eliminate_clauses);
+  s.eliminate_clauses_time += (read_cpu_time() - start_eliminate_clauses);
   
   return 0;
 }
 
-int FerpManager::checkResolution(uint32_t index)
+int FerpManager::checkResolution(uint32_t index, uint32_t parent1_index, uint32_t parent2_index)
 {
-  const std::vector<Lit>* prop_clause = trace_clauses[index];
-  const std::vector<Lit>* _parent1 = trace_clauses[cnf_id_to_trace_id[antecedents[index]->at(0)]];
-  const std::vector<Lit>* _parent2 = trace_clauses[cnf_id_to_trace_id[antecedents[index]->at(1)]];
+  const ClauseRef prop_clause = trace_clauses[index];
+  const ClauseRef _parent1 = trace_clauses[parent1_index];
+  const ClauseRef _parent2 = trace_clauses[parent2_index];
 
   std::vector<Lit> parent1;
-  for (auto lit : *_parent1) {
+  for (auto lit : _parent1) {
     if (std::find(parent1.begin(), parent1.end(), lit) == parent1.end())
       parent1.push_back(lit);
   }
   std::vector<Lit> parent2;
-  for (auto lit : *_parent2) {
+  for (auto lit : _parent2) {
     if (std::find(parent2.begin(), parent2.end(), lit) == parent2.end())
       parent2.push_back(lit);
   }
@@ -412,7 +773,7 @@ int FerpManager::checkResolution(uint32_t index)
   std::vector<Var> pivot_candidates;
   auto li1 = parent1.begin();
   auto li2 = parent2.begin();
-  auto res = prop_clause->begin();
+  auto res = prop_clause.begin();
   
   while(li1 != parent1.end() && li2 != parent2.end())
   {
@@ -457,7 +818,7 @@ int FerpManager::checkResolution(uint32_t index)
   }
   
   // check that no additional elements are there
-  if(res != prop_clause->end()) return 11;
+  if(res != prop_clause.end()) return 11;
   // check if clause not tautological
   if(pivot_candidates.size() != 1) return 12;
   
@@ -469,35 +830,8 @@ int FerpManager::checkRedundant()
   // check if root exists
   if(root == 0) return 13;
   
-  std::vector<bool> mark(trace_clauses.size(), false);
-  std::vector<uint32_t> queue;
-  queue.push_back(root);
-  mark[root] = true;
-  
-  // todo: cycle detection
-  
-  while(!queue.empty())
-  {
-    uint32_t node = queue.back();
-    queue.pop_back();
-    
-    uint32_t next = antecedents[node]->at(1);
-    if(next == 0) continue;
-    next = cnf_id_to_trace_id[next];
-    if(!mark[next])
-    {
-      mark[next] = true;
-      queue.push_back(next);
-    }
-    
-    next = cnf_id_to_trace_id[antecedents[node]->at(0)];
-    
-    if(!mark[next])
-    {
-      mark[next] = true;
-      queue.push_back(next);
-    }
-  }
+  std::vector<bool> mark;
+  markReachable(mark);
   
   for(uint32_t i = 1; i < mark.size(); i++)
     if(!mark[i]) return 14;
@@ -529,7 +863,11 @@ int FerpManager::extract(const Formula& qbf)
         aiger_add_input(aig, aiger_var2lit(*vit), nullptr);
   }
   
-  uint32_t num_prop = prop_to_original.rbegin()->first + 1;
+  uint32_t num_prop = prop_to_original.maxVar() + 1;
+  
+  // depth lookups in the loops below are plain array loads
+  prop_depth.assign(num_prop, 0);
+  prop_to_original.forEach([&](Var prop, Var orig) { prop_depth[prop] = (uint32_t)qbf.getVarDepth(orig); });
   
   current_aig_var = (uint32_t)(qbf.numVars() + 1);
   
@@ -548,10 +886,10 @@ int FerpManager::extract(const Formula& qbf)
       if(pivots[ci] != 0) continue;
 
       mark[ci] = true;
-      const std::vector<Lit>* clause = trace_clauses[ci];
-      for(uint32_t li = 0; li < clause->size(); li++)
+      const ClauseRef clause = trace_clauses[ci];
+      for(uint32_t li = 0; li < clause.size(); li++)
       {
-        const Var prop_v = var(clause->at(li));
+        const Var prop_v = var(clause[li]);
         active[ci][prop_v] = aiger_true;
         cumulative[ci][prop_v] = aiger_true;
       }
@@ -566,8 +904,8 @@ int FerpManager::extract(const Formula& qbf)
       {
         if(mark[ci]) continue;
 
-        uint32_t parent1 = antecedents[ci]->at(0);
-        uint32_t parent2 = antecedents[ci]->at(1);
+        uint32_t parent1 = antecedents[ci][0];
+        uint32_t parent2 = antecedents[ci][1];
         Var pivot = pivots[ci];
         assert(pivot != 0);
 
@@ -576,11 +914,11 @@ int FerpManager::extract(const Formula& qbf)
         mark[ci] = true;
         updated = true;
 
-        const std::vector<Lit>* clause = trace_clauses[ci];
+        const ClauseRef clause = trace_clauses[ci];
 
-        for(uint32_t li = 0; li < clause->size(); li++)
+        for(uint32_t li = 0; li < clause.size(); li++)
         {
-          const Var prop_v = var(clause->at(li));
+          const Var prop_v = var(clause[li]);
           active[ci][prop_v] = aiger_true;
         }
 
@@ -638,17 +976,17 @@ int FerpManager::extract(const Formula& qbf)
       if(pivots[ci] != 0) continue;
       
       mark[ci] = true;
-      const std::vector<Lit>* clause = trace_clauses[ci];
+      const ClauseRef clause = trace_clauses[ci];
       
       // generate cube of negated literals in previous existential quantifier
       uint32_t out = aiger_not(top[ci]); // continue from previously computed cube
-      for(uint32_t li = 0; li < clause->size(); li++)
+      for(uint32_t li = 0; li < clause.size(); li++)
       {
-        const Lit l = clause->at(li);
+        const Lit l = clause[li];
         // ignore literals not in previous existential layer
-        if(qbf.getVarDepth(prop_to_original[var(l)]) != (qi - 1)) continue;
+        if(prop_depth[var(l)] != (qi - 1)) continue;
         
-        uint32_t rhs = make_aiger_lit(prop_to_original[var(l)], !sign(l));
+        uint32_t rhs = make_aiger_lit(prop_to_original.get(var(l)), !sign(l));
         
         out = makeAND(out, rhs);
       }
@@ -658,10 +996,10 @@ int FerpManager::extract(const Formula& qbf)
       top[ci] = aiger_not(out);
       debugf("top value for %d : %d\n", ci, top[ci]);
       // active/cumulative if not assigned, and clause is not satisfied by assignment
-      for(uint32_t li = 0; li < clause->size(); li++)
+      for(uint32_t li = 0; li < clause.size(); li++)
       {
-        const Var prop_v = var(clause->at(li));
-        uint32_t a = (qbf.getVarDepth(prop_to_original[prop_v]) < qi) ? aiger_false : out;
+        const Var prop_v = var(clause[li]);
+        uint32_t a = (prop_depth[prop_v] < qi) ? aiger_false : out;
 
         debugf("active, cumulative for %d_%d : %d\n", prop_v, ci, a);
 
@@ -689,8 +1027,8 @@ int FerpManager::extract(const Formula& qbf)
       {
         if(mark[ci]) continue;
         
-        uint32_t parent1 = antecedents[ci]->at(0);
-        uint32_t parent2 = antecedents[ci]->at(1);
+        uint32_t parent1 = antecedents[ci][0];
+        uint32_t parent2 = antecedents[ci][1];
         Var pivot = pivots[ci];
         assert(pivot != 0);
         
@@ -806,17 +1144,17 @@ void FerpManager::collectPivots()
   pivots.clear();
   pivots.resize(trace_clauses.size(), 0);
   // assumes that everything is ok with the proof
-  for(int i = 1; i < trace_clauses.size(); i++)
+  for(uint32_t i = 1; i < trace_clauses.size(); i++)
   {
-    if(antecedents[i]->at(1) == 0) continue;
+    if(antecedents[i][1] == 0) continue;
   
-    const std::vector<Lit>* parent1 = trace_clauses[cnf_id_to_trace_id[antecedents[i]->at(0)]];
-    const std::vector<Lit>* parent2 = trace_clauses[cnf_id_to_trace_id[antecedents[i]->at(1)]];
+    const ClauseRef parent1 = trace_clauses[cnf_id_to_trace_id.get(antecedents[i][0])];
+    const ClauseRef parent2 = trace_clauses[cnf_id_to_trace_id.get(antecedents[i][1])];
     
-    auto li1 = parent1->begin();
-    auto li2 = parent2->begin();
+    auto li1 = parent1.begin();
+    auto li2 = parent2.begin();
     
-    while(li1 != parent1->end() && li2 != parent2->end())
+    while(li1 != parent1.end() && li2 != parent2.end())
     {
       const Var v1 = var(*li1);
       const Var v2 = var(*li2);
@@ -827,7 +1165,7 @@ void FerpManager::collectPivots()
       else if(*li1 == *li2)
         li1++, li2++;
       else
-        pivots[i] = v1, li1 = parent1->end();
+        pivots[i] = v1, li1 = parent1.end();
     }
     assert(pivots[i] != 0);
   }
@@ -836,17 +1174,17 @@ void FerpManager::collectPivots()
 void FerpManager::collectIndicators()
 {
   indicators.clear();
-  for(const auto& p2a : prop_to_annotation)
+  prop_to_annotation.forEach([&](Var prop, uint32_t anno)
   {
-    const std::vector<Lit>& anno = *(p2a.second);
-    for(const Lit l : anno)
+    for(const Lit* li = annotations.begin(anno); li != annotations.end(anno); li++)
     {
+      const Lit l = *li;
       auto ind_iter = indicators.find(l);
       if(ind_iter == indicators.end())
         ind_iter = indicators.insert(std::pair<Lit, std::vector<Var>>(l, std::vector<Var>())).first;
-      ind_iter->second.push_back(p2a.first);
+      ind_iter->second.push_back(prop);
     }
-  }
+  });
 }
 
 FerpManager::Redundancy FerpManager::findRedundant(uint32_t a, uint32_t b)
@@ -876,7 +1214,7 @@ void FerpManager::checkOscillation()
   std::set<uint32_t> permanent;
   std::set<uint32_t> temporary;
 
-  for(int oi = 0; oi < aig->num_outputs; oi++)
+  for(unsigned oi = 0; oi < aig->num_outputs; oi++)
   {
     if(triv_out.find(aig->outputs[oi].lit) != triv_out.end()) continue;
 
@@ -912,3 +1250,93 @@ cleanup:
 }
 
 #endif // FERP_CERT
+
+#ifdef FERP_TRIM
+int FerpManager::trim(FerpWriter& writer)
+{
+  kept_steps = 0;
+  kept_variables = 0;
+  if(is_sat) return 1;
+  if(root == 0) return 13;
+  
+  // antecedents as trace indices, 0 for axioms
+  std::vector<std::array<uint32_t, 2>> parents(trace_clauses.size(), {0, 0});
+  for(uint32_t i = 1; i < trace_clauses.size(); i++)
+  {
+    if(antecedents[i][1] == 0) continue;
+    for(int j = 0; j < 2; j++)
+    {
+      if(!cnf_id_to_trace_id.find(antecedents[i][j], parents[i][j]) || parents[i][j] == 0) return 16;
+    }
+  }
+  
+  // depth-first post order from the root, antecedents come before their steps
+  std::vector<uint32_t> order;
+  std::vector<uint8_t> state(trace_clauses.size(), 0); // 0 new, 1 on stack, 2 done
+  std::vector<std::pair<uint32_t, int>> stack;
+  stack.push_back(std::make_pair(root, 0));
+  state[root] = 1;
+  while(!stack.empty())
+  {
+    uint32_t node = stack.back().first;
+    int& child = stack.back().second;
+    if(parents[node][1] == 0 || child == 2)
+    {
+      state[node] = 2;
+      order.push_back(node);
+      stack.pop_back();
+      continue;
+    }
+    uint32_t next = parents[node][child++];
+    if(state[next] == 1) return 15;
+    if(state[next] == 0)
+    {
+      state[next] = 1;
+      stack.push_back(std::make_pair(next, 0));
+    }
+  }
+  
+  std::vector<uint32_t> new_id(trace_clauses.size(), 0);
+  for(uint32_t i = 0; i < order.size(); i++)
+    new_id[order[i]] = i + 1;
+  
+  // expansion variables of the kept clauses, grouped by annotation
+  std::vector<std::vector<Var>> used(annotations.size());
+  std::vector<bool> seen;
+  for(const uint32_t node : order)
+  {
+    for(const Lit l : trace_clauses[node])
+    {
+      Var v = var(l);
+      if(v >= seen.size()) seen.resize(v + 1, false);
+      if(seen[v]) continue;
+      seen[v] = true;
+      used[prop_to_annotation.get(v)].push_back(v);
+    }
+  }
+  
+  writer.writeSAT(false);
+  std::vector<Var> original;
+  for(uint32_t i = 0; i < annotations.size(); i++)
+  {
+    if(used[i].empty()) continue;
+    std::sort(used[i].begin(), used[i].end());
+    original.clear();
+    for(const Var v : used[i])
+      original.push_back(prop_to_original.get(v));
+    writer.writeVariables(used[i], original, std::vector<Lit>(annotations.begin(i), annotations.end(i)));
+    kept_variables += (uint32_t)used[i].size();
+  }
+  
+  for(const uint32_t node : order)
+  {
+    std::array<uint32_t, 2> ante = antecedents[node];
+    if(ante[1] != 0) ante = {new_id[parents[node][0]], new_id[parents[node][1]]};
+    const ClauseRef clause = trace_clauses[node];
+    writer.writeStep(new_id[node], clause.begin(), clause.size(), ante, false, nullptr, 0);
+  }
+  kept_steps = (uint32_t)order.size();
+  
+  return 0;
+}
+#endif // FERP_TRIM
@@ -6,11 +6,24 @@
 #define FERPCHECK_FERPMENAGER_H
 
 #include <stdint.h>
+#include <algorithm>
+#include <array>
 #include <vector>
 #include <map>
 #include <set>
 #include "common.h"
+#include "AnnotationTable.h"
+#include "Assignment.h"
+#include "ClauseArena.h"
+#include "FlatLists.h"
 #include "Formula.h"
+#include "IdIndex.h"
+#include "VarMap.h"
+
+class MappedFile;
+#ifdef FERP_TRIM
+class FerpWriter;
+#endif // FERP_TRIM
 
 #ifdef FERP_CERT
 #include <unordered_map>
@@ -22,16 +35,53 @@ extern "C" {
 class FerpManager
 {
 private:
-  std::map<Var,Var> prop_to_original;
-  std::map<Var, std::vector<Lit>*> prop_to_annotation;
-  std::vector<std::vector<Lit>*> annotations;
+  friend class SnapshotCache;
+  
+  VarMap<Var> prop_to_original;
+  VarMap<uint32_t> prop_to_annotation;
+  AnnotationTable annotations;
   
   std::vector<uint32_t> trace_id_to_cnf_id;          ///< Clause ids as they appear in the trace
-  std::map<uint32_t, uint32_t> cnf_id_to_trace_id;   ///< Lookup table in other direction
-  std::vector<std::array<uint32_t, 2>*> antecedents; ///< Stores antecedents of each trace clause
+  IdIndex cnf_id_to_trace_id;                        ///< Lookup table in other direction
+  std::vector<std::array<uint32_t, 2>> antecedents;  ///< Stores antecedents of each trace clause
+  
+  /// Kinds of variables occurring in a trace
+  enum VarKind : uint8_t {VAR_UNKNOWN, VAR_EXPANSION, VAR_HELPER};
+  VarMap<uint8_t> var_kinds;                         ///< Kind of each variable of the trace
+  VarMap<uint32_t> helper_rows;                      ///< Row of each helper variable in #helper_offsets
+  std::vector<uint32_t> helper_offsets;              ///< Literals of row r are #helper_lits[offsets[r]] to [offsets[r + 1]]
+  std::vector<Lit> helper_lits;                      ///< Literals of all helper definitions, ordered by row
+  std::vector<std::pair<uint32_t, Lit>> helper_pending; ///< Literals added since the last call to finaliseHelpers()
+  
+  /// Buffers reused by the checks of one thread and the times they took
+  struct Scratch
+  {
+    std::vector<Lit> orig_ex;                         ///< Original literals of the clause being checked
+    std::vector<uint32_t> clause_annos;               ///< Distinct annotations of the axiom being checked
+    AnnotationTable::CompatibleCache compatible_cache;
+    Assignment assignment;                            ///< Assignment of the nor clause being checked
+    std::vector<Lit> residual;                        ///< Remaining clauses under the assignment, each ended by 0
+    std::vector<uint32_t> residual_clauses;           ///< Matrix index of each clause in #residual
+    void* solver = nullptr;                           ///< Solver holding the matrix in incremental mode
+    std::vector<uint32_t> conflict_clauses;           ///< Failed clause assumptions of the last failed elimination check
+    std::vector<Lit> conflict_assignment;             ///< Failed assignment assumptions of the last failed elimination check
+    uint32_t sat_calls = 0;
+    double check_nor_time = 0;
+    double check_elimination_time = 0;
+    double check_sat_time = 0;
+    double find_assignment_time = 0;
+    double eliminate_clauses_time = 0;
+  };
+  Scratch scratch;                                   ///< Buffers of the calling thread
   
-  std::vector<Lit> orig_ex;
   uint32_t root;
+  bool resolved_antecedents;                         ///< Whether resolution steps store trace indices instead of antecedent ids
+  MappedFile* snapshot;                              ///< Snapshot #nor_clauses and #nor_originals point into, if loaded from one
+  
+  void markReachable(std::vector<bool>& mark);
+  
+  /// Records expansion variable \a prop of \a orig under annotation \a anno_id, returns false if \a prop is known
+  bool addExpansionVariable(Var prop, Var orig, uint32_t anno_id);
 #ifdef FERP_CERT
   aiger* aig;                                            ///< AIG in which the model is stored
   uint32_t current_aig_var;                              ///< Current AIG variable, returned at next call to newVar()
@@ -40,17 +90,35 @@ private:
   std::unordered_map<uint64_t, uint32_t> node_cache;     ///< Cache Map for reusing AND gates
   std::unordered_map<uint32_t, uint64_t> inv_node_cache; ///< Inverse of node_cache
   std::set<uint64_t> triv_out;                           ///< Trivial outputs
+  std::vector<uint32_t> prop_depth;                     ///< Quantifier depth of the original of each expansion variable
   enum Redundancy {RED_NONE, RED_FALSE, RED_OTHER};      ///< Used for signaling in find_redundant
 #endif
   
 #ifdef FERP_CHECK
+  const Formula* online_qbf;                    ///< Formula added clauses are checked against, nullptr if checking after reading
+  bool backward;                                ///< Whether only clauses reachable from the root are checked
+  unsigned threads;                             ///< Number of threads checking the steps after reading
+  bool incremental;                             ///< Whether each thread checks eliminations with one solver
+  std::multimap<uint32_t, uint32_t> waiting;    ///< Resolution steps waiting for the antecedent with the given id
+  std::vector<uint32_t> deferred;               ///< Deleted ids, released once no step is waiting
+  
+  int checkAdded(uint32_t index);
+  int checkIfReady(uint32_t index);
+  void releaseDeferred();
   int checkSAT(const Formula& qbf);
   int checkUNSAT(const Formula& qbf);
-  int checkExpansionUNSAT(const Formula& qbf, uint32_t index);
-  int checkResolution(uint32_t index);
+  int checkExpansionUNSAT(const Formula& qbf, uint32_t index, Scratch& s);
+  int checkResolution(uint32_t index, uint32_t parent1, uint32_t parent2);
   int checkRedundant();
-  int checkExpansionSAT(const Formula& qbf, std::vector<Lit>* prop_clause, uint32_t origin_idx);
-  int checkElimination(const Formula& qbf, uint32_t origin_idx, std::vector<Lit> assignment);
+  int checkExpansionSAT(const Formula& qbf, uint32_t index, Scratch& s);
+  int checkElimination(const Formula& qbf, uint32_t origin_idx, Assignment& assignment, Scratch& s);
+  void* initIncrementalSolver(const Formula& qbf);
+  void finishScratch(Scratch& s);
+  void printConflict(const Scratch& s);
+  void addTimes(const Scratch& s);
+  
+  /// Literal that switches on clause \a index of \a qbf in the solver of initIncrementalSolver()
+  static Lit activationLit(const Formula& qbf, unsigned index) { return (Lit)(qbf.numVars() + 1 + index); }
 #endif
 #ifdef FERP_CERT
   void collectPivots();
@@ -68,42 +136,112 @@ public:
   ~FerpManager();
 
   bool is_sat;
-  /** maps helper variables to literals of clause that introduces the helper variable */
-  std::map<Var, std::vector<Lit>*> helper_variable_mapping;
-  std::vector<std::vector<Lit>*> nor_clauses;
+  FlatLists<Lit> nor_clauses;                   ///< Literals of the nor clauses of a SAT trace, in trace order
+  FlatLists<uint32_t> nor_originals;            ///< Original clause ids of each literal of #nor_clauses, in the same order
   std::vector<uint32_t> res_clause_ids;
-  // std::vector<std::vector<uint32_t>*>  original_clause_mapping;
-  std::vector<std::vector<std::vector<uint32_t>*>*>  original_clause_mapping;
+  int online_result;                            ///< Code of the first failed online check, 0 if there is none
   uint32_t sat_calls;
+  uint32_t skipped_steps;
   double check_sat_time;
   double check_nor_time;
   double check_elimination_time;  
   double check_resolution_time;
   double find_assignment_time;
   double eliminate_clauses_time;
-  bool isHelper(Var v);
+  
+  /// Returns true if \a v has been introduced by an x-line
+  bool isExpansion(Var v) const { return var_kinds.get(v) == VAR_EXPANSION; }
+  
+  /// Returns true if \a v has been defined by an expansion step of a SAT trace
+  bool isHelper(Var v) const { return var_kinds.get(v) == VAR_HELPER; }
+  
+  /// Appends \a num_lits literals to the definition of helper variable \a helper
+  /** They only become visible to the checks after finaliseHelpers(). */
+  void addHelperLits(Var helper, const Lit* lits, size_t num_lits);
+  
+  /// Moves the helper literals added so far into the rows of their helper variables
+  void finaliseHelpers();
 
-  std::vector<std::vector<Lit>*> trace_clauses;      ///< Clauses as they appear in the trace
+  ClauseArena trace_clauses;                         ///< Clauses as they appear in the trace
   
   int addVariables(const std::vector<Var>& prop, const std::vector<Var>& orig, const std::vector<Lit>& anno);
-  int addClause(uint32_t id, std::vector<Lit>* clause, std::array<uint32_t, 2>* ante);
+  /// Adds a step with the \a num_lits literals at \a lits, they are copied and sorted
+  int addClause(uint32_t id, const Lit* lits, size_t num_lits, const std::array<uint32_t, 2>& ante);
+  
+  /// Handles the deletion of the clause with id \a id
+  /** With online checking the clause and its id are released as soon as no
+   * waiting step can refer to it any more, the antecedents are kept for the
+   * final reachability check. Otherwise check() frees clauses after their last
+   * use on its own and the deletion is only validated.
+   */
+  int deleteClause(uint32_t id);
 #ifdef FERP_CHECK
+  /// Checks the steps of UNSAT traces while they are added
+  /** Axioms are checked right away, resolution steps as soon as both antecedents
+   * are present. The code of the first bad step is left in #online_result, the
+   * reader stops there. check() then only has to handle what is left.
+   */
+  void checkOnline(const Formula& qbf)
+  {
+    online_qbf = &qbf;
+    resolved_antecedents = true;
+  }
+  
+  /// Checks only the steps of UNSAT traces the empty clause depends on
+  /** Reachable clauses are marked from the root first, all other steps are
+   * skipped and counted in #skipped_steps instead of failing the check.
+   */
+  void checkBackward() { backward = true; }
+  
+  /// Checks traces on \a num_threads threads after reading
+  /** For UNSAT traces every thread checks consecutive steps, for SAT traces the
+   * threads take the next nor clause. The first failing step is the same as
+   * with a single thread.
+   */
+  void checkParallel(unsigned num_threads) { threads = std::max(num_threads, 1u); }
+  
+  /// Checks the eliminations of SAT traces with one incremental solver per thread
+  /** The solver holds every matrix clause with an activation literal, the
+   * clauses to eliminate and the assignment of each nor clause are assumed.
+   */
+  void checkIncremental() { incremental = true; }
   int check(const Formula& qbf);
 #endif
 #ifdef FERP_CERT
   int extract(const Formula& qbf);
   int writeAiger(FILE* file);
 #endif
+#ifdef FERP_TRIM
+  /// Writes the steps the empty clause of an UNSAT trace depends on to \a writer
+  /** Steps are written in topological order with ids 1, 2, ..., only expansion
+   * variables occurring in them are kept.
+   * @return 0 on success, 1 for SAT traces, 13 without empty clause, 15 on a cycle,
+   *         16 for an unknown antecedent
+   */
+  int trim(FerpWriter& writer);
+  uint32_t kept_steps;     ///< Number of steps written by trim()
+  uint32_t kept_variables; ///< Number of expansion variables written by trim()
+#endif
 };
 
 //////////// INLINE IMPLEMENTATIONS ////////////
 
 FerpManager::FerpManager() :
 root(0),
-is_sat(false)
+resolved_antecedents(false),
+snapshot(nullptr),
 #ifdef FERP_CERT
-, aig(nullptr), current_aig_var(0)
+aig(nullptr), current_aig_var(0),
+#endif
+#ifdef FERP_CHECK
+online_qbf(nullptr),
+backward(false),
+threads(1),
+incremental(false),
 #endif
+is_sat(false),
+online_result(0),
+skipped_steps(0)
 {};
 
 #ifdef FERP_CERT
@@ -3,16 +3,48 @@
 //
 
 #include "FerpReader.h"
+#include "FerpWriter.h"
+
+#include <string.h>
+#include <thread>
 
 int FerpReader::readFERP(FerpManager& mngr)
 {
-  readSATLine(mngr);
-  if(readExpansions(mngr)) return 1;
-  if(readResolutions(mngr)) return 2;
-  return 0;
+  mngr_ = &mngr;
+  writer_ = nullptr;
+  int res = readTrace();
+  mngr.finaliseHelpers();
+  return res;
+}
+
+int FerpReader::readFERP(FerpWriter& writer)
+{
+  mngr_ = nullptr;
+  writer_ = &writer;
+  return readTrace();
 }
 
-int FerpReader::readExpansions(FerpManager& mngr)
+int FerpReader::readTrace()
+{
+  int res = 0;
+  if (*stream == binary_ferp_magic[0])
+  {
+    if (!eagerMatch(stream, (const char*)binary_ferp_magic)) res = 1;
+    else res = readBinary();
+  }
+  else
+  {
+    readSATLine();
+    if(readExpansions()) res = 1;
+    else if(readResolutions()) res = 2;
+  }
+  
+  // a broken compressed input ends early, the steps read so far are incomplete
+  if (stream.failed()) return 3;
+  return res;
+}
+
+int FerpReader::readExpansions()
 {
   std::vector<Var> propositional;
   std::vector<Var> original;
@@ -22,7 +54,7 @@ int FerpReader::readExpansions(FerpManager& mngr)
   {
     ++stream;
     skipWhitespace(stream);
-    Var v; Lit l;
+    Var v;
     propositional.clear();
     while (true)
     {
@@ -39,21 +71,24 @@ int FerpReader::readExpansions(FerpManager& mngr)
     }
     if(propositional.size() != original.size()) return 3;
     annotation.clear();
-    while (true)
-    {
-      if (parseSigned(l)) return 4;
-      if (l == 0) break;
-      annotation.push_back(l);
-    }
-    if(mngr.addVariables(propositional, original, annotation)) return 5;
+    if (parseLits(annotation)) return 4;
+    if(addVariables(propositional, original, annotation)) return 5;
   }
   return 0;
 }
 
-int FerpReader::readResolutions(FerpManager& mngr)
+int FerpReader::readResolutions()
 {
   // skip id 0
-  mngr.addClause(0, new std::vector<Lit>(), new std::array<uint32_t, 2>());
+  if (mngr_) mngr_->addClause(0, nullptr, 0, {{0, 0}});
+  
+  std::vector<Chunk> chunks;
+  splitInput(chunks, false);
+  if (!chunks.empty())
+  {
+    int res = readResolutionsParallel(chunks);
+    if (res >= 0) return res;
+  }
 
   bool expansion_part = true;
   
@@ -67,15 +102,21 @@ int FerpReader::readResolutions(FerpManager& mngr)
     }
 
     int res;
-    if (mngr.is_sat) {
-      res = readClauseSAT(mngr, expansion_part);
+    steps_.clear();
+    if (*stream == 'd') {
+      res = readDeletion(steps_);
+    } else if (is_sat_) {
+      res = readClauseSAT(steps_, expansion_part);
     } else {
-      res = readClause(mngr);
+      res = readClause(steps_);
     }
+    if (!res) res = addSteps(steps_);
 
     if (res)
     {
-      printf("Reading clause failed with error code %d\n", res);
+      // steps failing the online check are reported by the caller
+      if (!mngr_ || mngr_->online_result == 0)
+        printf("Reading clause failed with error code %d\n", res);
       return 6;
     }
   }
@@ -83,157 +124,449 @@ int FerpReader::readResolutions(FerpManager& mngr)
   return 0;
 }
 
-#define clean(val) do {ret = val; goto cleanup;} while(0)
+int FerpReader::readResolutionsParallel(const std::vector<Chunk>& chunks)
+{
+  // 'r' only occurs on the separator line, chunks before it start in the expansion part
+  const unsigned char* separator = (const unsigned char*)memchr(stream.cursor(), 'r', stream.available());
+  if (separator == nullptr) separator = stream.cursor() + stream.available();
+  
+  std::vector<StepBuffer> steps(chunks.size());
+  
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < chunks.size(); i++)
+    workers.emplace_back([&, i]()
+    {
+      MemoryInputSource source(chunks[i].begin, chunks[i].size);
+      FerpReader reader(source);
+      reader.quiet = true;
+      reader.readChunk(steps[i], is_sat_, chunks[i].begin < separator);
+    });
+  for (std::thread& w : workers)
+    w.join();
+  
+  // chunks end at any line, a step continuing in the next chunk leaves its own
+  // chunk unfinished. The sequential reader sorts this out and reports real errors.
+  for (const StepBuffer& s : steps)
+    if (s.error) return -1;
+  stream.advance(stream.available());
+  
+  // ids are assigned to trace positions in file order
+  for (size_t i = 0; i < chunks.size(); i++)
+  {
+    int res = addSteps(steps[i]);
+    if (res)
+    {
+      // steps failing the online check are reported by the caller
+      if (!mngr_ || mngr_->online_result == 0)
+        printf("Reading clause failed with error code %d\n", res);
+      return 6;
+    }
+    steps[i] = StepBuffer();
+  }
+  
+  return 0;
+}
 
-int FerpReader::readClause(FerpManager& mngr)
+void FerpReader::readChunk(StepBuffer& steps, bool is_sat, bool expansion_part)
 {
-  int ret = 0;
-  std::vector<Lit>* clause = new std::vector<Lit>();
-  std::array<uint32_t, 2>* ante = new std::array<uint32_t, 2>();
+  skipWhitespace(stream);
+  while (*stream != EOF)
+  {
+    if (*stream == 'r') {
+      skipLine(stream);
+      expansion_part = false;
+      continue;
+    }
+    
+    if (*stream == 'd')
+      steps.error = readDeletion(steps);
+    else
+      steps.error = is_sat ? readClauseSAT(steps, expansion_part) : readClause(steps);
+    if (steps.error) return;
+  }
+}
+
+int FerpReader::readBinary()
+{
+  std::vector<std::vector<Lit>> annotations; // annotation table
+  std::vector<Var> propositional;
+  std::vector<Var> original;
+  uint64_t last_id = 0;
+  bool expansion_part = true;
+  uint64_t v, n;
   
-  Lit l = 0;
-  uint32_t index = 0;
-  if (parseUnsigned(index)) clean(1);
+  // skip id 0
+  if (mngr_) mngr_->addClause(0, nullptr, 0, {{0, 0}});
+  
+  while (*stream != EOF)
+  {
+    const int type = *stream;
+    ++stream;
+    
+    if (type == 's')
+    {
+      if (parseVarint(v)) return 1;
+      setSAT(v == 1);
+    }
+    else if (type == 'n')
+    {
+      if (parseVarint(n)) return 1;
+      annotations.emplace_back();
+      for (uint64_t i = 0; i < n; i++)
+      {
+        if (parseVarint(v) || v < 2 || v > 2 * (uint64_t)INT32_MAX + 1) return 1;
+        annotations.back().push_back(make_lit((Var)(v >> 1), v & 1));
+      }
+    }
+    else if (type == 'x')
+    {
+      uint64_t entry;
+      if (parseVarint(entry) || entry >= annotations.size()) return 1;
+      if (parseVarint(n)) return 1;
+      propositional.clear();
+      original.clear();
+      int64_t prop = 0;
+      for (uint64_t i = 0; i < n; i++)
+      {
+        if (parseVarint(v)) return 1;
+        prop += (v & 1) ? -(int64_t)(v >> 1) - 1 : (int64_t)(v >> 1);
+        if (prop <= 0 || prop > INT32_MAX) return 1;
+        propositional.push_back((Var)prop);
+        if (parseVarint(v) || v == 0 || v > INT32_MAX) return 1;
+        original.push_back((Var)v);
+      }
+      if (addVariables(propositional, original, annotations[entry])) return 1;
+    }
+    else if (type == 'r')
+    {
+      expansion_part = false;
+    }
+    else
+    {
+      steps_.clear();
+      int res = readBinaryStep(steps_, type, expansion_part, last_id);
+      if (!res) res = addSteps(steps_);
+      if (res)
+      {
+        // steps failing the online check are reported by the caller
+        if (!mngr_ || mngr_->online_result == 0)
+          printf("Reading clause failed with error code %d\n", res);
+        return 2;
+      }
+    }
+  }
+  
+  return 0;
+}
+
+/// Decodes a zigzag coded delta to \a base, fails if the result is no valid id
+static inline bool applyDelta(uint64_t delta, uint64_t base, uint64_t& id)
+{
+  int64_t value = (int64_t)base + ((delta & 1) ? -(int64_t)(delta >> 1) - 1 : (int64_t)(delta >> 1));
+  if (value < 0 || value > UINT32_MAX) return false;
+  id = (uint64_t)value;
+  return true;
+}
+
+int FerpReader::readBinaryStep(StepBuffer& steps, int type, bool expansion_part, uint64_t& last_id)
+{
+  std::array<uint32_t, 2> ante = {0, 0};
+  uint64_t v, index, a;
+  
+  if (type == 'd')
+  {
+    if (parseVarint(v) || v == 0 || v > UINT32_MAX) return 1;
+    steps.ids.push_back((uint32_t)v);
+    steps.lits_end.push_back(steps.lits.size());
+    steps.antecedents.push_back(ante);
+    steps.expansion.push_back(false);
+    steps.originals_end.push_back(steps.originals.size());
+    steps.deletion.push_back(true);
+    return 0;
+  }
+  if (type != 'i' && type != 'c' && type != 'e') return 9;
+  if (type == 'i' && is_sat_) return 9;
+  if (type == 'e' && (!is_sat_ || !expansion_part)) return 9;
+  
+  if (parseVarint(v) || !applyDelta(v, last_id, index)) return 1;
   while (true)
   {
-    if (parseSigned(l)) clean(2);
-    if (l == 0) break;
-    clause->push_back(l);
+    if (parseVarint(v)) return 2;
+    if (v == 0) break;
+    if (v < 2 || v > 2 * (uint64_t)INT32_MAX + 1) return 2;
+    steps.lits.push_back(make_lit((Var)(v >> 1), v & 1));
   }
   
-  if (parseUnsigned(ante->at(0))) clean(3);
-  if (ante->at(0) == 0) clean(4);
-  if (parseUnsigned(ante->at(1))) clean(5);
-  if (ante->at(1) != 0)
+  if (type == 'i')
   {
-    if (parseSigned(l)) clean(6);
-    if (l != 0) clean(7);
+    if (parseVarint(v) || v > UINT32_MAX) return 3;
+    if (v == 0) return 4;
+    ante[0] = (uint32_t)v;
+  }
+  else if (type == 'c')
+  {
+    if (parseVarint(v) || !applyDelta(v, index, a)) return 3;
+    if (a == 0) return 4;
+    ante[0] = (uint32_t)a;
+    if (parseVarint(v) || !applyDelta(v, index, a)) return 5;
+    ante[1] = (uint32_t)a;
+  }
+  else
+  {
+    // lists of original clause ids, terminated by an empty list
+    uint64_t count;
+    while (true)
+    {
+      if (parseVarint(count)) return 3;
+      if (count == 0) break;
+      for (uint64_t i = 0; i < count; i++)
+      {
+        if (parseVarint(v) || v == 0 || v > UINT32_MAX) return 3;
+        steps.originals.push_back((uint32_t)v);
+      }
+      steps.originals.push_back(0);
+    }
   }
   
-  if (mngr.addClause(index, clause, ante)) clean(8);
+  last_id = index;
+  steps.ids.push_back((uint32_t)index);
+  steps.lits_end.push_back(steps.lits.size());
+  steps.antecedents.push_back(ante);
+  steps.expansion.push_back(type == 'e');
+  steps.originals_end.push_back(steps.originals.size());
+  steps.deletion.push_back(false);
   return 0;
-cleanup:
-  delete clause;
-  delete ante;
-  return ret;
 }
 
-#define cleanSAT(val) do {ret = val; goto cleanupsat;} while(0)
+void FerpReader::StepBuffer::clear()
+{
+  ids.clear();
+  lits_end.clear();
+  lits.clear();
+  antecedents.clear();
+  expansion.clear();
+  deletion.clear();
+  originals_end.clear();
+  originals.clear();
+  error = 0;
+}
+
+// A line is only appended to the buffer once it has been parsed completely,
+// leftovers of a failed line behind the last step are ignored.
 
-int FerpReader::readClauseSAT(FerpManager& mngr, bool expansion_part)
+int FerpReader::readClause(StepBuffer& steps)
 {
-  int ret = 0;
-  bool is_nor_clause = true;
-  std::vector<Lit>* clause = new std::vector<Lit>();
-  std::array<uint32_t, 2>* ante = new std::array<uint32_t, 2>();
-  Var helper_variable = 0;
-  std::vector<Lit>* literal_array = new std::vector<Lit>();
+  std::array<uint32_t, 2> ante = {0, 0};
   
   Lit l = 0;
   uint32_t index = 0;
-  if (parseUnsigned(index)) cleanSAT(1);
-  while (true)
+  if (parseUnsigned(index)) return 1;
+  if (parseLits(steps.lits)) return 2;
+  
+  if (parseUnsigned(ante[0])) return 3;
+  if (ante[0] == 0) return 4;
+  if (parseUnsigned(ante[1])) return 5;
+  if (ante[1] != 0)
   {
-    if (parseSigned(l)) cleanSAT(2);
-    if (l == 0) break;
-    clause->push_back(l);
+    if (parseSigned(l)) return 6;
+    if (l != 0) return 7;
+  }
+  
+  steps.ids.push_back(index);
+  steps.lits_end.push_back(steps.lits.size());
+  steps.antecedents.push_back(ante);
+  steps.expansion.push_back(false);
+  steps.originals_end.push_back(steps.originals.size());
+  steps.deletion.push_back(false);
+  return 0;
+}
 
-    if (expansion_part) {
-      if (!sign(l) && mngr.isHelper(var(l))) {
-        helper_variable = var(l);
-        is_nor_clause = false;
-      } else {
-        literal_array->push_back(l);
-      }
-    }  
+int FerpReader::readDeletion(StepBuffer& steps)
+{
+  ++stream;
+  skipWhitespace(stream);
+  
+  std::vector<uint32_t> deleted;
+  while (true)
+  {
+    uint32_t index = 0;
+    if (parseUnsigned(index)) return 1;
+    if (index == 0) break;
+    deleted.push_back(index);
   }
   
-  if (!expansion_part)
+  for (const uint32_t index : deleted)
   {
-    delete literal_array;
+    steps.ids.push_back(index);
+    steps.lits_end.push_back(steps.lits.size());
+    steps.antecedents.push_back({0, 0});
+    steps.expansion.push_back(false);
+    steps.originals_end.push_back(steps.originals.size());
+    steps.deletion.push_back(true);
+  }
+  return 0;
+}
 
-    if (parseUnsigned(ante->at(0))) cleanSAT(3);
-    if (ante->at(0) == 0) cleanSAT(4);
-    if (parseUnsigned(ante->at(1))) cleanSAT(5);
+int FerpReader::readClauseSAT(StepBuffer& steps, bool expansion_part)
+{
+  std::array<uint32_t, 2> ante = {0, 0};
+  
+  Lit l = 0;
+  uint32_t index = 0;
+  if (parseUnsigned(index)) return 1;
+  if (parseLits(steps.lits)) return 2;
+  
+  if (!expansion_part)
+  {
+    if (parseUnsigned(ante[0])) return 3;
+    if (ante[0] == 0) return 4;
+    if (parseUnsigned(ante[1])) return 5;
     // must contain 2 references
-    if (ante->at(0) == 0) cleanSAT(4);
-    if (parseSigned(l)) cleanSAT(6);
-    if (l != 0) cleanSAT(7);
-    mngr.res_clause_ids.push_back(mngr.trace_clauses.size()); 
+    if (ante[0] == 0) return 4;
+    if (parseSigned(l)) return 6;
+    if (l != 0) return 7;
   }
   else
   {
-
-    std::vector<std::vector<uint32_t>*> *oo = new std::vector<std::vector<uint32_t>*>();
+    // lists of original clause ids, terminated by an empty list
     while (true)
     {
-      std::vector<uint32_t> *originals = new std::vector<uint32_t>();
       uint32_t original_clause_id = 0;
-
-      if (parseUnsigned(original_clause_id)) cleanSAT(3);
-      if (original_clause_id == 0) {
-        assert(originals->size() == 0);
-        delete originals;
-        break;
-      }
       
-      originals->push_back(original_clause_id);
+      if (parseUnsigned(original_clause_id)) return 3;
+      if (original_clause_id == 0) break;
+      
+      steps.originals.push_back(original_clause_id);
       while (true)
       {
-        if (parseUnsigned(original_clause_id)) cleanSAT(3);
+        if (parseUnsigned(original_clause_id)) return 3;
         if (original_clause_id == 0) break;
-        originals->push_back(original_clause_id);
+        steps.originals.push_back(original_clause_id);
       }
-      oo->push_back(originals);
-    }
-    // uint32_t original_clause_id = 0;
-    // while (true)
-    // {
-    //   if (parseUnsigned(original_clause_id)) cleanSAT(3);
-    //   if (original_clause_id == 0) break;
-    //   original_clause_ids->push_back(original_clause_id);
-    // }
+      steps.originals.push_back(0);
+    }
+  }
+  
+  steps.ids.push_back(index);
+  steps.lits_end.push_back(steps.lits.size());
+  steps.antecedents.push_back(ante);
+  steps.expansion.push_back(expansion_part);
+  steps.originals_end.push_back(steps.originals.size());
+  steps.deletion.push_back(false);
+  return 0;
+}
+
+int FerpReader::addSteps(const StepBuffer& steps)
+{
+  size_t lits_begin = 0;
+  size_t originals_begin = 0;
+  
+  if (writer_)
+  {
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+      if (steps.deletion[i])
+      {
+        writer_->writeDeletion(steps.ids[i]);
+        continue;
+      }
+      writer_->writeStep(steps.ids[i], steps.lits.data() + lits_begin, steps.lits_end[i] - lits_begin,
+                         steps.antecedents[i], is_sat_ && steps.expansion[i],
+                         steps.originals.data() + originals_begin, steps.originals_end[i] - originals_begin);
+      lits_begin = steps.lits_end[i];
+      originals_begin = steps.originals_end[i];
+    }
+    return 0;
+  }
+  
+  FerpManager& mngr = *mngr_;
+  std::vector<Lit> literal_array;
+  
+  for (size_t i = 0; i < steps.size(); i++)
+  {
+    if (steps.deletion[i])
+    {
+      if (mngr.deleteClause(steps.ids[i])) return 9;
+      continue;
+    }
+    
+    const Lit* clause = steps.lits.data() + lits_begin;
+    const size_t num_lits = steps.lits_end[i] - lits_begin;
     
-    if (is_nor_clause)
+    if (mngr.is_sat && steps.expansion[i])
     {
-      delete literal_array;
-      assert(oo->size() == clause->size());
-      mngr.original_clause_mapping.push_back(oo);
+      bool is_nor_clause = true;
+      Var helper_variable = 0;
+      literal_array.clear();
       
-      std::vector<Lit>* copy_clause = new std::vector<Lit>();
-      for (auto lit : *clause) {
-        copy_clause->push_back(lit);
+      for (const Lit* li = clause; li != clause + num_lits; li++) {
+        const Lit l = *li;
+        if (!sign(l) && !mngr.isExpansion(var(l))) {
+          helper_variable = var(l);
+          is_nor_clause = false;
+        } else {
+          literal_array.push_back(l);
+        }
       }
-      mngr.nor_clauses.push_back(copy_clause);
-    } else {
-      assert(oo->size() == 0);
-      delete oo;
-
-      if (mngr.helper_variable_mapping.count(helper_variable) > 0) {
-        auto helper_arr = mngr.helper_variable_mapping[helper_variable];
-        helper_arr->insert(helper_arr->end(), literal_array->begin(), literal_array->end());
-        delete literal_array;
+      
+      if (is_nor_clause)
+      {
+        // one list of original clauses per literal, each terminated by 0
+        size_t num_lists = 0;
+        for (size_t j = originals_begin, list = originals_begin; j < steps.originals_end[i]; j++)
+        {
+          if (steps.originals[j] != 0) continue;
+          if (++num_lists > num_lits) return 10;
+          mngr.nor_originals.add(steps.originals.data() + list, j - list);
+          list = j + 1;
+        }
+        if (num_lists != num_lits) return 10;
+        mngr.nor_clauses.add(clause, num_lits);
       } else {
-        mngr.helper_variable_mapping[helper_variable] = literal_array;
-      }      
+        assert(originals_begin == steps.originals_end[i]);
+        
+        mngr.addHelperLits(helper_variable, literal_array.data(), literal_array.size());
+      }
     }
+    else if (mngr.is_sat)
+    {
+      mngr.res_clause_ids.push_back(mngr.trace_clauses.size());
+    }
+    
+    lits_begin = steps.lits_end[i];
+    originals_begin = steps.originals_end[i];
+    
+    if (mngr.addClause(steps.ids[i], clause, num_lits, steps.antecedents[i])) return 8;
+    if (mngr.online_result) return 8;
   }
-  
-  if (mngr.addClause(index, clause, ante)) cleanSAT(8);
   return 0;
-cleanupsat:
-  delete clause;
-  delete ante;
-  return ret;
 }
 
-void FerpReader::readSATLine(FerpManager& mngr)
+void FerpReader::readSATLine()
 {
   while (*stream == 's') {
     ++stream;
     skipWhitespace(stream);
     unsigned is_sat;
     parseUnsigned(is_sat);
-    mngr.is_sat = (is_sat == 1);
+    setSAT(is_sat == 1);
+  }
+}
+
+void FerpReader::setSAT(bool is_sat)
+{
+  is_sat_ = is_sat;
+  if (mngr_) mngr_->is_sat = is_sat;
+  if (writer_) writer_->writeSAT(is_sat);
+}
+
+int FerpReader::addVariables(const std::vector<Var>& propositional, const std::vector<Var>& original,
+                             const std::vector<Lit>& annotation)
+{
+  if (writer_)
+  {
+    writer_->writeVariables(propositional, original, annotation);
+    return 0;
   }
+  return mngr_->addVariables(propositional, original, annotation);
 }
\ No newline at end of file
@@ -7,17 +7,79 @@
 
 #include "Reader.h"
 
+class FerpWriter;
+
 class FerpReader : protected Reader
 {
 private:
-  int readExpansions(FerpManager& mngr);
-  int readResolutions(FerpManager& mngr);
-  int readClause(FerpManager& mngr);
-  int readClauseSAT(FerpManager& mngr, bool expansion_part);
-  void readSATLine(FerpManager& mngr);
+  /// Proof lines of the resolution section, parsed but not yet added to a FerpManager
+  struct StepBuffer
+  {
+    std::vector<uint32_t> ids;                         ///< Clause id of each step
+    std::vector<size_t> lits_end;                      ///< End of the literals of each step in #lits
+    std::vector<Lit> lits;                             ///< Literals of all steps
+    std::vector<std::array<uint32_t, 2>> antecedents;  ///< Antecedents of each step, 0 for expansion steps
+    std::vector<bool> expansion;                       ///< Whether a step belongs to the expansion part (SAT)
+    std::vector<bool> deletion;                        ///< Whether a step deletes the clause with its id
+    std::vector<size_t> originals_end;                 ///< End of the original clause lists of each step in #originals
+    std::vector<uint32_t> originals;                   ///< Original clause lists of expansion steps, each terminated by 0
+    int error = 0;                                     ///< Error code of the first line that could not be parsed
+    
+    size_t size() const { return ids.size(); }
+    void clear();
+  };
+  
+  StepBuffer steps_;   ///< Buffer for sequential reading
+  FerpManager* mngr_;  ///< Receives the trace, unless it is copied to #writer_
+  FerpWriter* writer_; ///< Receives the trace when converting
+  bool is_sat_;        ///< Whether the trace is a SAT trace
+  
+  /// Reads a text or binary trace, detected by #binary_ferp_magic
+  int readTrace();
+  
+  int readExpansions();
+  int readResolutions();
+  
+  /// Reads the resolution section split into \a chunks on several threads, steps are added in order
+  /** @return -1 without consuming any input if a chunk can not be parsed, the section has to be read sequentially */
+  int readResolutionsParallel(const std::vector<Chunk>& chunks);
+  
+  /// Reads all lines of a chunk into \a steps, stops at the first error
+  void readChunk(StepBuffer& steps, bool is_sat, bool expansion_part);
+  
+  /// Reads a single line in UNSAT format into \a steps
+  int readClause(StepBuffer& steps);
+  
+  /// Reads a single line in SAT format into \a steps
+  int readClauseSAT(StepBuffer& steps, bool expansion_part);
+  
+  /// Reads a deletion line "d <id>... 0" into \a steps
+  int readDeletion(StepBuffer& steps);
+  
+  /// Reads a whole trace in binary format, see BinaryFerpWriter
+  int readBinary();
+  
+  /// Reads a single step record of type \a type in binary format into \a steps
+  int readBinaryStep(StepBuffer& steps, int type, bool expansion_part, uint64_t& last_id);
+  
+  /// Adds all steps of \a steps in order to #mngr_ or #writer_
+  int addSteps(const StepBuffer& steps);
+  
+  /// Passes expansion variables on to #mngr_ or #writer_
+  int addVariables(const std::vector<Var>& propositional, const std::vector<Var>& original,
+                   const std::vector<Lit>& annotation);
+  
+  void setSAT(bool is_sat);
+  void readSATLine();
 public:
+  /// Reads a text or binary trace into \a mngr
   int readFERP(FerpManager& mngr);
-  FerpReader(gzFile& file) : Reader(file) {};
+  
+  /// Reads a text or binary trace and copies it record by record to \a writer
+  int readFERP(FerpWriter& writer);
+  
+  FerpReader(InputSource& source, unsigned num_threads = 1)
+  : Reader(source, num_threads), mngr_(nullptr), writer_(nullptr), is_sat_(false) {};
 };
 
 
@@ -0,0 +1,205 @@
+//
+// Writers for FERP traces in text and binary format
+//
+
+#include "FerpWriter.h"
+
+FerpWriter::FerpWriter(FILE* o) : out(o), is_sat(false), expansion_part(true)
+{
+  buffer.reserve(1 << 20);
+}
+
+int FerpWriter::flush()
+{
+  size_t written = fwrite(buffer.data(), 1, buffer.size(), out);
+  bool failed = written != buffer.size();
+  buffer.clear();
+  return failed || fflush(out) != 0;
+}
+
+void FerpWriter::putVarint(uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    put((char)(value | 0x80));
+    value >>= 7;
+  }
+  put((char)value);
+}
+
+void FerpWriter::putNumber(int64_t value)
+{
+  char digits[24];
+  int n = 0;
+  uint64_t v = value < 0 ? -(uint64_t)value : value;
+  if (value < 0) put('-');
+  do
+  {
+    digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v != 0);
+  while (n > 0) put(digits[--n]);
+}
+
+//////////// TEXT FORMAT ////////////
+
+void TextFerpWriter::writeSAT(bool sat)
+{
+  is_sat = sat;
+  if (!sat) return;
+  put('s'); put(' '); put('1'); put('\n');
+}
+
+void TextFerpWriter::writeVariables(const std::vector<Var>& propositional, const std::vector<Var>& original,
+                                    const std::vector<Lit>& annotation)
+{
+  put('x');
+  for (Var v : propositional)
+  {
+    put(' ');
+    putNumber(v);
+  }
+  put(' '); put('0');
+  for (Var v : original)
+  {
+    put(' ');
+    putNumber(v);
+  }
+  put(' '); put('0');
+  for (Lit l : annotation)
+  {
+    put(' ');
+    putNumber(l);
+  }
+  put(' '); put('0'); put('\n');
+}
+
+void TextFerpWriter::writeStep(uint32_t id, const Lit* lits, size_t num_lits, const std::array<uint32_t, 2>& ante,
+                               bool expansion, const uint32_t* originals, size_t num_originals)
+{
+  if (separate(expansion))
+  {
+    put('r'); put('\n');
+  }
+
+  putNumber(id);
+  for (size_t i = 0; i < num_lits; i++)
+  {
+    put(' ');
+    putNumber(lits[i]);
+  }
+  put(' '); put('0');
+
+  if (expansion)
+  {
+    for (size_t i = 0; i < num_originals; i++)
+    {
+      put(' ');
+      putNumber(originals[i]);
+    }
+  }
+  else
+  {
+    put(' ');
+    putNumber(ante[0]);
+    if (ante[1] != 0 || is_sat)
+    {
+      put(' ');
+      putNumber(ante[1]);
+    }
+  }
+  put(' '); put('0'); put('\n');
+}
+
+void TextFerpWriter::writeDeletion(uint32_t id)
+{
+  put('d'); put(' ');
+  putNumber(id);
+  put(' '); put('0'); put('\n');
+}
+
+//////////// BINARY FORMAT ////////////
+
+BinaryFerpWriter::BinaryFerpWriter(FILE* o) : FerpWriter(o), last_id(0)
+{
+  for (unsigned char c : binary_ferp_magic)
+    put((char)c);
+}
+
+void BinaryFerpWriter::putLits(const Lit* lits, size_t num_lits)
+{
+  for (size_t i = 0; i < num_lits; i++)
+    putVarint(2 * (uint64_t)var(lits[i]) + sign(lits[i]));
+  put(0);
+}
+
+void BinaryFerpWriter::writeSAT(bool sat)
+{
+  is_sat = sat;
+  put('s');
+  putVarint(sat);
+}
+
+void BinaryFerpWriter::writeVariables(const std::vector<Var>& propositional, const std::vector<Var>& original,
+                                      const std::vector<Lit>& annotation)
+{
+  auto entry = annotation_ids.find(annotation);
+  if (entry == annotation_ids.end())
+  {
+    entry = annotation_ids.emplace(annotation, (uint32_t)annotation_ids.size()).first;
+    put('n');
+    putVarint(annotation.size());
+    for (Lit l : annotation)
+      putVarint(2 * (uint64_t)var(l) + sign(l));
+  }
+
+  put('x');
+  putVarint(entry->second);
+  putVarint(propositional.size());
+  Var last = 0;
+  for (size_t i = 0; i < propositional.size(); i++)
+  {
+    putDelta((int64_t)propositional[i] - last);
+    putVarint(original[i]);
+    last = propositional[i];
+  }
+}
+
+void BinaryFerpWriter::writeStep(uint32_t id, const Lit* lits, size_t num_lits, const std::array<uint32_t, 2>& ante,
+                                 bool expansion, const uint32_t* originals, size_t num_originals)
+{
+  if (separate(expansion))
+    put('r');
+
+  put(expansion ? 'e' : (!is_sat && ante[1] == 0) ? 'i' : 'c');
+  putDelta((int64_t)id - last_id);
+  putLits(lits, num_lits);
+  last_id = id;
+
+  if (expansion)
+  {
+    for (size_t begin = 0, end; begin < num_originals; begin = end + 1)
+    {
+      for (end = begin; originals[end] != 0; end++);
+      putVarint(end - begin);
+      for (size_t i = begin; i < end; i++)
+        putVarint(originals[i]);
+    }
+    putVarint(0);
+  }
+  else if (!is_sat && ante[1] == 0)
+  {
+    putVarint(ante[0]);
+  }
+  else
+  {
+    putDelta((int64_t)ante[0] - id);
+    putDelta((int64_t)ante[1] - id);
+  }
+}
+
+void BinaryFerpWriter::writeDeletion(uint32_t id)
+{
+  put('d');
+  putVarint(id);
+}
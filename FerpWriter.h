@@ -0,0 +1,116 @@
+//
+// Writers for FERP traces in text and binary format
+//
+
+#ifndef FERPCHECK_FERPWRITER_H
+#define FERPCHECK_FERPWRITER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <array>
+#include <map>
+#include <vector>
+#include "common.h"
+
+/// Magic number at the start of a binary FERP trace
+static const unsigned char binary_ferp_magic[4] = {0x7f, 'F', 'R', 'P'};
+
+/// Writes a FERP trace record by record
+/** Records have to arrive in trace order: the SAT line, expansion variables
+ * and then the steps, as delivered by FerpReader::readFERP(FerpWriter&).
+ */
+class FerpWriter
+{
+protected:
+  FILE* out;           ///< Output file, not owned
+  bool is_sat;         ///< Whether the trace is a SAT trace
+  bool expansion_part; ///< Whether the separator of a SAT trace is still to be written
+
+  std::vector<char> buffer;
+
+  void put(char c)
+  {
+    if (buffer.size() == buffer.capacity()) flush();
+    buffer.push_back(c);
+  }
+  void putVarint(uint64_t value);
+  void putNumber(int64_t value);
+
+  /// Returns true if a SAT trace switches from expansion to resolution steps before a step
+  bool separate(bool expansion)
+  {
+    if (!is_sat || expansion || !expansion_part) return false;
+    expansion_part = false;
+    return true;
+  }
+public:
+  explicit FerpWriter(FILE* o);
+  virtual ~FerpWriter() {}
+
+  /// Writes buffered output to #out, returns non-zero on a write error
+  int flush();
+
+  virtual void writeSAT(bool sat) = 0;
+  virtual void writeVariables(const std::vector<Var>& propositional, const std::vector<Var>& original,
+                              const std::vector<Lit>& annotation) = 0;
+
+  /// Writes a single step
+  /** @param ante Antecedents, original clause id and 0 for expansion steps of an UNSAT trace
+   * @param expansion Whether it is an expansion step of a SAT trace
+   * @param originals Original clause lists of a SAT expansion step, each terminated by 0
+   */
+  virtual void writeStep(uint32_t id, const Lit* lits, size_t num_lits, const std::array<uint32_t, 2>& ante,
+                         bool expansion, const uint32_t* originals, size_t num_originals) = 0;
+
+  /// Writes the deletion of the clause with id \a id
+  virtual void writeDeletion(uint32_t id) = 0;
+};
+
+/// Writes the textual format read by FerpReader
+class TextFerpWriter : public FerpWriter
+{
+public:
+  explicit TextFerpWriter(FILE* o) : FerpWriter(o) {}
+
+  void writeSAT(bool sat);
+  void writeVariables(const std::vector<Var>& propositional, const std::vector<Var>& original,
+                      const std::vector<Lit>& annotation);
+  void writeStep(uint32_t id, const Lit* lits, size_t num_lits, const std::array<uint32_t, 2>& ante,
+                 bool expansion, const uint32_t* originals, size_t num_originals);
+  void writeDeletion(uint32_t id);
+};
+
+/// Writes the binary format
+/** After #binary_ferp_magic the trace is a sequence of records, each starting with
+ * a type byte. Numbers are unsigned LEB128 varints, literals are mapped to 2 * var + sign
+ * and lists of literals are terminated by 0. Step ids are coded as zigzag delta to the
+ * previous id, antecedents as zigzag delta to the id of their step.
+ *
+ *   's' sat                          SAT line
+ *   'n' count lit...                 next entry of the annotation table
+ *   'x' entry count (dprop orig)...  expansion variables, props delta coded, annotation by table entry
+ *   'i' did lit... 0 orig            expansion step of an UNSAT trace
+ *   'e' did lit... 0 (count id...)... 0   expansion step of a SAT trace with its original clause lists
+ *   'c' did lit... 0 dante dante     resolution step
+ *   'r'                              separator between expansion and resolution steps of a SAT trace
+ *   'd' id                           deletion of a clause
+ */
+class BinaryFerpWriter : public FerpWriter
+{
+  std::map<std::vector<Lit>, uint32_t> annotation_ids; ///< Annotation table written so far
+  uint32_t last_id;                                    ///< Id of the previous step
+
+  void putDelta(int64_t delta) { putVarint(delta < 0 ? ((uint64_t)(-delta) << 1) - 1 : (uint64_t)delta << 1); }
+  void putLits(const Lit* lits, size_t num_lits);
+public:
+  explicit BinaryFerpWriter(FILE* o);
+
+  void writeSAT(bool sat);
+  void writeVariables(const std::vector<Var>& propositional, const std::vector<Var>& original,
+                      const std::vector<Lit>& annotation);
+  void writeStep(uint32_t id, const Lit* lits, size_t num_lits, const std::array<uint32_t, 2>& ante,
+                 bool expansion, const uint32_t* originals, size_t num_originals);
+  void writeDeletion(uint32_t id);
+};
+
+#endif //FERPCHECK_FERPWRITER_H
@@ -0,0 +1,66 @@
+//
+// Lists of values stored one after the other
+//
+
+#ifndef FERPCHECK_FLATLISTS_H
+#define FERPCHECK_FLATLISTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// Lists of values of type \a T, concatenated in one array with the end offset of each list
+/** The arrays are either owned and appended to with add(), or borrowed with
+ * attach(), e.g. from a mapped snapshot that has to outlive the lists.
+ */
+template <typename T>
+class FlatLists
+{
+  std::vector<uint64_t> own_ends;  ///< End offsets of the lists added with add()
+  std::vector<T> own_values;       ///< Values of the lists added with add()
+  const uint64_t* ends;            ///< End of each list in #values
+  const T* values;
+  size_t num_lists;
+public:
+  FlatLists() : ends(nullptr), values(nullptr), num_lists(0) {}
+  FlatLists(const FlatLists&) = delete;
+  FlatLists& operator=(const FlatLists&) = delete;
+
+  /// Appends a list of the \a n values at \a begin
+  void add(const T* begin, size_t n)
+  {
+    own_values.insert(own_values.end(), begin, begin + n);
+    own_ends.push_back(own_values.size());
+    ends = own_ends.data();
+    values = own_values.data();
+    num_lists = own_ends.size();
+  }
+
+  /// Replaces the lists by \a n lists with the end offsets \a e into \a v, which are not copied
+  void attach(const uint64_t* e, size_t n, const T* v)
+  {
+    std::vector<uint64_t>().swap(own_ends);
+    std::vector<T>().swap(own_values);
+    ends = e;
+    values = v;
+    num_lists = n;
+  }
+
+  /// Returns the number of lists
+  size_t size() const { return num_lists; }
+
+  /// Returns the number of values of all lists
+  uint64_t numValues() const { return num_lists == 0 ? 0 : ends[num_lists - 1]; }
+
+  /// Offset of the first value of list \a i, values of consecutive lists have consecutive offsets
+  uint64_t beginOffset(size_t i) const { return i == 0 ? 0 : ends[i - 1]; }
+  uint64_t endOffset(size_t i) const { return ends[i]; }
+
+  const T* begin(size_t i) const { return values + beginOffset(i); }
+  const T* end(size_t i) const { return values + ends[i]; }
+
+  const uint64_t* endsData() const { return ends; }
+  const T* valuesData() const { return values; }
+};
+
+#endif //FERPCHECK_FLATLISTS_H
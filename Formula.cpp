@@ -5,19 +5,23 @@
 #include "Formula.h"
 
 #include "Clause.h"
+#include "Snapshot.h"
 
 #include <algorithm>
 #include <iostream>
 
 Formula::~Formula()
 {
+  if (snapshot != nullptr)
+  {
+    delete snapshot;
+    return;
+  }
   for (Quant* q : prefix)
     Quant::destroy_quant(q);
-  for (Clause* c : matrix)
-    Clause::destroy_clause(c);
 }
 
-Formula::Formula()
+Formula::Formula() : clauses(nullptr), snapshot(nullptr)
 {
   prefix.push_back(nullptr);
   position_counters.push_back(0);
@@ -25,46 +29,51 @@ Formula::Formula()
 
 void Formula::addClause(std::vector<Lit>& c)
 {
-  { // scope used for clause simplification
-    std::sort(c.begin(), c.end(), lit_order);
-    bool tautology = false;
-    std::vector<Lit>::const_iterator i = c.begin();
-    std::vector<Lit>::iterator j = c.begin();
-    Lit prev = 0;
-    while (i != c.end())
-    {
-      Lit lit = *i++;
-      if (lit == -prev)
-      {
-        tautology = true;
-        break;
-      }
-      if (lit !=  prev) *j++ = prev = lit;
-    }
-    
-    if (tautology) return;
-    
-    if (j != c.end())
-      c.resize(j - c.begin());
+  if (!simplifyClause(c)) return;
+  addSimplifiedClause(c.data(), c.data() + c.size());
+}
+
+bool Formula::simplifyClause(std::vector<Lit>& c)
+{
+  std::sort(c.begin(), c.end(), lit_order);
+  std::vector<Lit>::const_iterator i = c.begin();
+  std::vector<Lit>::iterator j = c.begin();
+  Lit prev = 0;
+  while (i != c.end())
+  {
+    Lit lit = *i++;
+    if (lit == -prev) return false;
+    if (lit !=  prev) *j++ = prev = lit;
   }
   
+  if (j != c.end())
+    c.resize(j - c.begin());
+  return true;
+}
+
+void Formula::addSimplifiedClause(const_lit_iterator begin, const_lit_iterator end)
+{
   tmp_exists.clear();
   tmp_forall.clear();
   
-  for (const Lit l : c)
+  for (const_lit_iterator l = begin; l != end; l++)
   {
-    const Var v = var(l);
+    const Var v = var(*l);
     if (!isQuantified(v))
       addFreeVar(v);
     
     if (isExistential(v))
-      tmp_exists.push_back(l);
+      tmp_exists.push_back(*l);
     else
-      tmp_forall.push_back(l);
+      tmp_forall.push_back(*l);
   }
   
-  Clause* clause = Clause::make_clause(tmp_exists, tmp_forall);
-  matrix.push_back(clause);
+  // records are appended to the arena, so the matrix can be released at once
+  size_t offset = clause_arena.size();
+  clause_arena.resize(offset + Clause::words(tmp_exists.size() + tmp_forall.size()));
+  Clause::place_clause(clause_arena.data() + offset, tmp_exists, tmp_forall);
+  matrix.push_back(offset);
+  clauses = clause_arena.data();
 }
 
 int Formula::addQuantifier(QuantType type, std::vector<Var>& variables)
@@ -134,8 +143,9 @@ void Formula::finalise()
   for(unsigned qi = 2; qi < prefix.size(); qi++)
     position_offset[qi] = position_offset[qi - 2] + prefix[qi-2]->size;
   
-  for(Clause* c : matrix)
+  for(const size_t offset : matrix)
   {
+    Clause* c = (Clause*)(clause_arena.data() + offset);
     int depth = -1;
     for(const_lit_iterator l = c->begin_e(); l != c->end_e(); l++)
       depth = std::max(depth, quant_depth[var(*l)]);
@@ -144,6 +154,31 @@ void Formula::finalise()
     assert(depth != -1 && (unsigned)depth < prefix.size());
     c->depth = (unsigned)depth;
   }
+  
+  buildOccurrences();
+}
+
+void Formula::buildOccurrences()
+{
+  occurrence_offsets.assign(2 * quant_depth.size() + 1, 0);
+  for(unsigned i = 0; i < matrix.size(); i++)
+  {
+    const Clause* c = getClause(i);
+    for(const_lit_iterator l = c->begin_e(); l != c->end_e(); l++)
+      occurrence_offsets[occurrenceIndex(*l) + 1]++;
+  }
+  for(size_t i = 1; i < occurrence_offsets.size(); i++)
+    occurrence_offsets[i] += occurrence_offsets[i - 1];
+  
+  // clauses are visited in order, so every list ends up sorted
+  occurrences.resize(occurrence_offsets.back());
+  std::vector<uint32_t> fill(occurrence_offsets.begin(), occurrence_offsets.end() - 1);
+  for(unsigned i = 0; i < matrix.size(); i++)
+  {
+    const Clause* c = getClause(i);
+    for(const_lit_iterator l = c->begin_e(); l != c->end_e(); l++)
+      occurrences[fill[occurrenceIndex(*l)]++] = i;
+  }
 }
 
 void Formula::addFreeVar(Var v)
@@ -12,8 +12,10 @@
 #include <iosfwd>
 #include <vector>
 #include <assert.h>
+#include <stdint.h>
 
 class Clause;
+class MappedFile;
 
 /// Class representing a quantified boolean formula
 class Formula
@@ -37,6 +39,13 @@ public:
    */
   void addClause(std::vector<Lit>& c);
   
+  /// Sorts \a c and removes duplicate literals, returns false if \a c is a tautology
+  /** Does not touch the Formula, so it can be called from several threads at once. */
+  static bool simplifyClause(std::vector<Lit>& c);
+  
+  /// Adds a clause already processed by simplifyClause(std::vector<Lit>&) to #matrix
+  void addSimplifiedClause(const_lit_iterator begin, const_lit_iterator end);
+  
   /// Adds an existential variable \a v to #free_variables
   void addFreeVar(Var v);
   
@@ -57,9 +66,18 @@ public:
   inline unsigned int getLocalPosition(Var v) const;
   inline int getVarDepth(Var v) const;
   
+  /// Returns the first index of a clause whose existential part contains \a l
+  /** The clauses containing \a l are listed in increasing order up to endOccurrences(Lit). */
+  inline const uint32_t* beginOccurrences(Lit l) const;
+  inline const uint32_t* endOccurrences(Lit l) const;
+  
 private:
-  std::vector<Quant*> prefix;  ///< Prefix of the QBF
-  std::vector<Clause*> matrix; ///< Matrix of the QBF
+  friend class SnapshotCache;
+  
+  std::vector<Quant*> prefix;    ///< Prefix of the QBF
+  std::vector<size_t> matrix;    ///< Matrix of the QBF, offset of each clause record in #clauses
+  std::vector<int> clause_arena; ///< Clause records one after the other, see Clause::words()
+  const int* clauses;            ///< Clause records, in #clause_arena or in #snapshot
   
   unsigned int num_exists;     ///< Number of existential variables
   unsigned int num_forall;     ///< Number of universal variables
@@ -69,12 +87,22 @@ private:
   std::vector<unsigned> position_counters; ///< Lookup table: \n index is the qunatifier \n value is size
   std::vector<unsigned> position_offset;   ///< Lookup table: \n index is the quantifier \n value is phase offset
   
+  std::vector<uint32_t> occurrence_offsets; ///< Lookup table: \n index is occurrenceIndex() of a literal \n value is its first entry in #occurrences
+  std::vector<uint32_t> occurrences;        ///< Indices of the clauses containing each existential literal, grouped by literal
+  
   std::vector<Var> free_variables; ///< Temporary vector of unquantified variables
   std::vector<Lit> tmp_exists;     ///< Temporary vector of existential variables
   std::vector<Lit> tmp_forall;     ///< Temporary vector of universal variables
   
+  MappedFile* snapshot;            ///< Snapshot holding #prefix and #matrix if loaded from a SnapshotCache
+  
   /// Quantifies variable \a v at quantifier with index \a depth
   int quantify(const Var v, unsigned depth);
+  
+  /// Fills #occurrence_offsets and #occurrences from #matrix
+  void buildOccurrences();
+  
+  static inline size_t occurrenceIndex(Lit l) { return 2 * (size_t)var(l) + sign(l); }
 };
 
 ////// INLINE FUNCTION DEFINITIONS //////
@@ -108,7 +136,7 @@ inline unsigned long Formula::numQuants() const
 
 inline const Clause* Formula::getClause(unsigned index) const
 {
-  return matrix[index];
+  return (const Clause*)(clauses + matrix[index]);
 }
 
 inline const Quant* Formula::getQuant(unsigned index) const
@@ -144,4 +172,16 @@ inline int Formula::getVarDepth(Var v) const
   return quant_depth[v];
 }
 
+inline const uint32_t* Formula::beginOccurrences(Lit l) const
+{
+  const size_t i = occurrenceIndex(l);
+  return occurrences.data() + (i + 1 < occurrence_offsets.size() ? occurrence_offsets[i] : 0);
+}
+
+inline const uint32_t* Formula::endOccurrences(Lit l) const
+{
+  const size_t i = occurrenceIndex(l);
+  return occurrences.data() + (i + 1 < occurrence_offsets.size() ? occurrence_offsets[i + 1] : 0);
+}
+
 #endif //NANOQBF_FORMULA_H
@@ -0,0 +1,110 @@
+//
+// Lookup of trace indices by clause id
+//
+
+#include "IdIndex.h"
+
+#include <algorithm>
+
+bool IdIndex::grow(uint32_t id)
+{
+  size_t limit = 4 * (count + 1) + 1024;
+  if ((size_t)id + 1 > limit) return false;
+
+  // grows geometrically, so that the hash table is rarely scanned
+  size_t old_size = direct.size();
+  direct.resize(std::max((size_t)id + 1, std::min(2 * old_size, limit)), 0);
+
+  // ids of the new range move over from the hash table
+  if (num_hashed != 0)
+  {
+    std::vector<uint32_t> old_keys, old_values;
+    old_keys.swap(keys);
+    old_values.swap(values);
+    num_hashed = 0;
+    keys.assign(old_keys.size(), 0);
+    values.assign(old_values.size(), 0);
+    for (size_t s = 0; s < old_keys.size(); s++)
+    {
+      if (old_keys[s] == 0) continue;
+      if (old_keys[s] >= old_size && old_keys[s] < direct.size())
+        direct[old_keys[s]] = old_values[s] + 1;
+      else
+        insertHashed(old_keys[s], old_values[s]);
+    }
+  }
+  return true;
+}
+
+void IdIndex::rehash(size_t capacity)
+{
+  std::vector<uint32_t> old_keys(capacity, 0);
+  std::vector<uint32_t> old_values(capacity, 0);
+  old_keys.swap(keys);
+  old_values.swap(values);
+  num_hashed = 0;
+  for (size_t s = 0; s < old_keys.size(); s++)
+    if (old_keys[s] != 0) insertHashed(old_keys[s], old_values[s]);
+}
+
+void IdIndex::insertHashed(uint32_t id, uint32_t index)
+{
+  // at most half of the slots are used
+  if (2 * (num_hashed + 1) > keys.size()) rehash(keys.empty() ? 16 : 2 * keys.size());
+
+  size_t s = slot(id);
+  while (keys[s] != 0) s = (s + 1) & (keys.size() - 1);
+  keys[s] = id;
+  values[s] = index;
+  num_hashed++;
+}
+
+bool IdIndex::insert(uint32_t id, uint32_t index)
+{
+  if (contains(id)) return false;
+
+  if (id < direct.size() || grow(id))
+    direct[id] = index + 1;
+  else
+    insertHashed(id, index);
+  count++;
+  return true;
+}
+
+bool IdIndex::erase(uint32_t id)
+{
+  if (id < direct.size())
+  {
+    if (direct[id] == 0) return false;
+    direct[id] = 0;
+    count--;
+    return true;
+  }
+  if (num_hashed == 0) return false;
+
+  size_t mask = keys.size() - 1;
+  size_t s = slot(id);
+  while (keys[s] != id)
+  {
+    if (keys[s] == 0) return false;
+    s = (s + 1) & mask;
+  }
+
+  // shift following entries back so that probing does not stop early
+  size_t hole = s;
+  for (size_t next = (s + 1) & mask; keys[next] != 0; next = (next + 1) & mask)
+  {
+    size_t home = slot(keys[next]);
+    // the entry may move into the hole if its home is not between hole and next
+    if (((next - home) & mask) >= ((next - hole) & mask))
+    {
+      keys[hole] = keys[next];
+      values[hole] = values[next];
+      hole = next;
+    }
+  }
+  keys[hole] = 0;
+  num_hashed--;
+  count--;
+  return true;
+}
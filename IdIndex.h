@@ -0,0 +1,84 @@
+//
+// Lookup of trace indices by clause id
+//
+
+#ifndef FERPCHECK_IDINDEX_H
+#define FERPCHECK_IDINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// Maps clause ids to trace indices
+/** Ids are nearly dense and increasing in practice. Ids up to the size of a
+ * direct array are looked up there, the array grows as long as at least a
+ * quarter of it is in use. Other ids go to an open addressing hash table with
+ * linear probing.
+ */
+class IdIndex
+{
+  std::vector<uint32_t> direct; ///< Index + 1 of each id below its size, 0 if absent
+  std::vector<uint32_t> keys;   ///< Ids in the hash table, 0 for empty slots as id 0 is always direct
+  std::vector<uint32_t> values; ///< Indices of the ids in #keys
+  size_t num_hashed;            ///< Number of ids in the hash table
+  size_t count;                 ///< Number of ids in the index
+
+  /// Returns the first slot of \a id in the hash table
+  size_t slot(uint32_t id) const { return (size_t)((id * 0x9E3779B97F4A7C15ULL) >> 32) & (keys.size() - 1); }
+
+  /// Extends #direct to \a id if it stays dense enough, returns false otherwise
+  bool grow(uint32_t id);
+  void insertHashed(uint32_t id, uint32_t index);
+  void rehash(size_t capacity);
+public:
+  IdIndex() : num_hashed(0), count(0) {}
+
+  /// Maps \a id to \a index, returns false if \a id is already present
+  bool insert(uint32_t id, uint32_t index);
+
+  /// Sets \a index to the index of \a id, returns false if \a id is not present
+  inline bool find(uint32_t id, uint32_t& index) const;
+
+  bool contains(uint32_t id) const
+  {
+    uint32_t index;
+    return find(id, index);
+  }
+
+  /// Returns the index of \a id, 0 if \a id is not present
+  uint32_t get(uint32_t id) const
+  {
+    uint32_t index = 0;
+    find(id, index);
+    return index;
+  }
+
+  /// Removes \a id, returns false if it is not present
+  bool erase(uint32_t id);
+
+  size_t size() const { return count; }
+};
+
+//////////// INLINE IMPLEMENTATIONS ////////////
+
+inline bool IdIndex::find(uint32_t id, uint32_t& index) const
+{
+  if (id < direct.size())
+  {
+    if (direct[id] == 0) return false;
+    index = direct[id] - 1;
+    return true;
+  }
+  if (num_hashed == 0) return false;
+  for (size_t s = slot(id); keys[s] != 0; s = (s + 1) & (keys.size() - 1))
+  {
+    if (keys[s] == id)
+    {
+      index = values[s];
+      return true;
+    }
+  }
+  return false;
+}
+
+#endif //FERPCHECK_IDINDEX_H
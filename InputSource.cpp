@@ -0,0 +1,849 @@
+//
+// Input sources feeding the StreamBuffer of a Reader
+//
+
+#include "InputSource.h"
+#include "Parallel.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+
+#ifdef FERP_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef FERP_HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef FERP_HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+void InputSource::fail()
+{
+  // only the first error is reported
+  if (!error.exchange(true)) printf("Error while decompressing input\n");
+}
+
+ThreadedInputSource::ThreadedInputSource()
+: filled(0), head(0), handed_out(false), stopping(false),
+  threaded(hardwareThreads() > 1)
+{
+  for (int i = 0; i < (threaded ? num_slots : 1); i++)
+    slots[i].reset(new unsigned char[buffer_size]);
+}
+
+ThreadedInputSource::~ThreadedInputSource()
+{
+  stop();
+}
+
+void ThreadedInputSource::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  slot_free.notify_all();
+  if (producer.joinable()) producer.join();
+}
+
+void ThreadedInputSource::run()
+{
+  unsigned tail = 0;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      slot_free.wait(lock, [this]() { return stopping || filled < (unsigned)num_slots; });
+      if (stopping) return;
+    }
+    
+    // the slot at tail is free, it is filled without holding the lock
+    size_t size = produce(slots[tail].get(), buffer_size);
+    
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      sizes[tail] = size;
+      filled++;
+    }
+    slot_filled.notify_one();
+    if (size == 0) return;
+    tail = (tail + 1) % num_slots;
+  }
+}
+
+size_t ThreadedInputSource::next(const unsigned char*& data)
+{
+  if (!threaded)
+  {
+    data = slots[0].get();
+    return produce(slots[0].get(), buffer_size);
+  }
+  
+  if (!producer.joinable() && !stopping)
+    producer = std::thread(&ThreadedInputSource::run, this);
+  
+  std::unique_lock<std::mutex> lock(mutex);
+  if (handed_out)
+  {
+    // the previous block is no longer used by the parser
+    if (sizes[head] == 0)
+    {
+      data = slots[head].get();
+      return 0;
+    }
+    head = (head + 1) % num_slots;
+    filled--;
+    slot_free.notify_one();
+  }
+  slot_filled.wait(lock, [this]() { return filled > 0; });
+  handed_out = true;
+  data = slots[head].get();
+  return sizes[head];
+}
+
+GzInputSource::~GzInputSource()
+{
+  stop();
+  gzclose(in);
+}
+
+size_t GzInputSource::produce(unsigned char* buf, size_t capacity)
+{
+  int read = gzread(in, buf, (unsigned)capacity);
+  if (read > 0) return (size_t)read;
+  
+  // truncated data ends like the input, zlib reports it as Z_BUF_ERROR
+  int err = Z_OK;
+  gzerror(in, &err);
+  if (err != Z_OK) fail();
+  return 0;
+}
+
+PipeInputSource::PipeInputSource(int f)
+: fd(f), strm(), in_buf(new unsigned char[buffer_size]), started(false), gzip(false), in_member(false), finished(false)
+{
+  if (pipe(wake) != 0) wake[0] = wake[1] = -1;
+}
+
+PipeInputSource::~PipeInputSource()
+{
+  // a producer waiting for data returns without reading
+  if (wake[1] >= 0)
+  {
+    ssize_t res;
+    do
+    {
+      res = write(wake[1], "", 1);
+    } while (res < 0 && errno == EINTR);
+  }
+  stop();
+  if (gzip) inflateEnd(&strm);
+  close(fd);
+  if (wake[0] >= 0) close(wake[0]);
+  if (wake[1] >= 0) close(wake[1]);
+}
+
+ssize_t PipeInputSource::readSome(unsigned char* buf, size_t capacity)
+{
+  struct pollfd fds[2] = {{fd, POLLIN, 0}, {wake[0], POLLIN, 0}};
+  while (true)
+  {
+    int ready = poll(fds, wake[0] >= 0 ? 2 : 1, -1);
+    if (ready < 0 && errno == EINTR) continue;
+    if (ready < 0) return -1;
+    if (fds[1].revents & POLLIN) return -2;
+    
+    ssize_t n = read(fd, buf, capacity);
+    if (n >= 0 || (errno != EINTR && errno != EAGAIN)) return n;
+  }
+}
+
+size_t PipeInputSource::produce(unsigned char* buf, size_t capacity)
+{
+  if (finished) return 0;
+  
+  if (!started)
+  {
+    // at least two bytes are needed to recognise gzip data
+    size_t n = 0;
+    ssize_t r = 1;
+    while (n < 2 && r > 0)
+    {
+      r = readSome(in_buf.get() + n, buffer_size - n);
+      if (r > 0) n += r;
+    }
+    started = true;
+    if (r < 0)
+    {
+      if (r == -1) fail();
+      finished = true;
+      return 0;
+    }
+    gzip = n >= 2 && in_buf[0] == 0x1f && in_buf[1] == 0x8b && inflateInit2(&strm, 15 + 16) == Z_OK;
+    if (!gzip)
+    {
+      memcpy(buf, in_buf.get(), n);
+      finished = n == 0;
+      return n;
+    }
+    strm.next_in = in_buf.get();
+    strm.avail_in = (uInt)n;
+    in_member = true;
+  }
+  
+  if (!gzip)
+  {
+    ssize_t n = readSome(buf, capacity);
+    if (n == -1) fail();
+    finished = n <= 0;
+    return n > 0 ? (size_t)n : 0;
+  }
+  
+  strm.next_out = buf;
+  strm.avail_out = (uInt)capacity;
+  while (strm.avail_out == capacity)
+  {
+    if (strm.avail_in == 0)
+    {
+      ssize_t n = readSome(in_buf.get(), buffer_size);
+      // the input must not end within a gzip member
+      if (n == -1 || (n == 0 && in_member)) fail();
+      if (n <= 0) break;
+      strm.next_in = in_buf.get();
+      strm.avail_in = (uInt)n;
+      in_member = true;
+    }
+    int ret = inflate(&strm, Z_NO_FLUSH);
+    // concatenated gzip members are read one after the other
+    if (ret == Z_STREAM_END)
+    {
+      inflateReset(&strm);
+      in_member = strm.avail_in > 0;
+    }
+    else if (ret != Z_OK && ret != Z_BUF_ERROR)
+    {
+      fail();
+      break;
+    }
+  }
+  finished = failed() || strm.avail_out == capacity;
+  return failed() ? 0 : capacity - strm.avail_out;
+}
+
+FrameInputSource::FrameInputSource(MappedFile* f, unsigned threads)
+: file(f), num_threads(threads), window(2 * threads), outputs(window), states(window, 0),
+  next_frame(0), current(0), handed_out(false), stopping(false)
+{
+}
+
+FrameInputSource::~FrameInputSource()
+{
+  stop();
+}
+
+void FrameInputSource::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  progress.notify_all();
+  for (std::thread& worker : workers)
+    worker.join();
+  workers.clear();
+}
+
+void FrameInputSource::run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    // frame i goes into the slot of frame i - window, which has to be released
+    progress.wait(lock, [this]() {
+      return stopping || next_frame >= frames.size() || next_frame < current + window;
+    });
+    if (stopping || next_frame >= frames.size()) return;
+    size_t index = next_frame++;
+
+    lock.unlock();
+    std::vector<unsigned char> out;
+    int res = decode(frames[index], out);
+    lock.lock();
+
+    outputs[index % window].swap(out);
+    states[index % window] = res == 0 ? 1 : 2;
+    progress.notify_all();
+  }
+}
+
+size_t FrameInputSource::next(const unsigned char*& data)
+{
+  if (workers.empty() && !stopping)
+  {
+    for (unsigned i = 0; i < num_threads; i++)
+      workers.emplace_back(&FrameInputSource::run, this);
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    if (handed_out)
+    {
+      // the previous frame is no longer used by the parser
+      std::vector<unsigned char>().swap(outputs[current % window]);
+      states[current % window] = 0;
+      current++;
+      handed_out = false;
+      progress.notify_all();
+    }
+    data = nullptr;
+    if (stopping || current >= frames.size()) return 0;
+
+    progress.wait(lock, [this]() { return states[current % window] != 0; });
+    if (states[current % window] == 2)
+    {
+      fail();
+      stopping = true;
+      progress.notify_all();
+      return 0;
+    }
+    handed_out = true;
+    data = outputs[current % window].data();
+    // empty frames are skipped, a block of size 0 ends the input
+    if (!outputs[current % window].empty()) return outputs[current % window].size();
+  }
+}
+
+size_t MemoryInputSource::next(const unsigned char*& block)
+{
+  block = data;
+  if (consumed) return 0;
+  consumed = true;
+  return size;
+}
+
+MappedInputSource::~MappedInputSource()
+{
+  munmap((void*)data, size);
+}
+
+MappedFile::~MappedFile()
+{
+  munmap((void*)data_, size_);
+}
+
+MappedFile* MappedFile::open(const char* file_name)
+{
+  int fd = ::open(file_name, O_RDONLY);
+  if (fd < 0) return nullptr;
+
+  struct stat st;
+  void* map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED) return nullptr;
+  return new MappedFile((const unsigned char*)map, (size_t)st.st_size);
+}
+
+//////////// DECOMPRESSORS ////////////
+
+/// Compressed data is grouped into frames of at least this size for the worker threads
+static const size_t min_frame_size = splitSize(4 * buffer_size);
+
+/// Decodes groups of BGZF blocks on several threads
+/** Every BGZF block is a complete gzip member whose size is stored in its header,
+ * so the blocks can be located without inflating anything.
+ */
+class BgzfInputSource : public FrameInputSource
+{
+protected:
+  int decode(const Frame& frame, std::vector<unsigned char>& out) const
+  {
+    z_stream strm = {};
+    if (inflateInit2(&strm, 15 + 16) != Z_OK) return 1;
+    strm.next_in = (Bytef*)frame.data;
+    strm.avail_in = (uInt)frame.size;
+    out.resize(std::max(4 * frame.size, (size_t)buffer_size));
+    size_t pos = 0;
+    int ret = Z_OK;
+    while (ret == Z_OK || (ret == Z_STREAM_END && strm.avail_in > 0))
+    {
+      // the group holds several gzip members
+      if (ret == Z_STREAM_END) inflateReset(&strm);
+      if (pos == out.size()) out.resize(2 * out.size());
+      strm.next_out = out.data() + pos;
+      strm.avail_out = (uInt)(out.size() - pos);
+      ret = inflate(&strm, Z_NO_FLUSH);
+      pos = out.size() - strm.avail_out;
+      if (ret == Z_BUF_ERROR && strm.avail_out == 0) ret = Z_OK;
+    }
+    inflateEnd(&strm);
+    out.resize(pos);
+    return ret != Z_STREAM_END;
+  }
+public:
+  BgzfInputSource(MappedFile* f, std::vector<Frame>&& fr, unsigned threads) : FrameInputSource(f, threads)
+  {
+    frames = std::move(fr);
+  }
+  ~BgzfInputSource() { stop(); }
+};
+
+/// Returns the size of the BGZF block at \a data, 0 if there is none
+static size_t bgzfBlockSize(const unsigned char* data, size_t size)
+{
+  if (size < 18 || data[0] != 0x1f || data[1] != 0x8b || data[2] != 8 || !(data[3] & 4)) return 0;
+  size_t xlen = data[10] | (size_t)data[11] << 8;
+  if (12 + xlen > size) return 0;
+  // look for the BC subfield holding the block size minus one
+  for (size_t pos = 12; pos + 4 <= 12 + xlen; pos += 4 + (data[pos + 2] | (size_t)data[pos + 3] << 8))
+  {
+    if (data[pos] == 'B' && data[pos + 1] == 'C' && data[pos + 2] == 2 && data[pos + 3] == 0 && pos + 6 <= 12 + xlen)
+      return (data[pos + 4] | (size_t)data[pos + 5] << 8) + 1;
+  }
+  return 0;
+}
+
+/// Reads the block offsets from the .gzi index next to \a file_name, if there is a usable one
+/** An index is only used if every offset points to the header of a BGZF block of \a file. */
+static std::vector<size_t> bgzfIndex(const char* file_name, const MappedFile& file)
+{
+  const size_t file_size = file.size();
+  std::vector<size_t> offsets;
+  std::unique_ptr<MappedFile> index(MappedFile::open((std::string(file_name) + ".gzi").c_str()));
+  if (!index) return offsets;
+
+  // little-endian entry count followed by pairs of compressed and uncompressed offsets
+  auto read = [&index](size_t pos) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--)
+      value = value << 8 | index->data()[pos + i];
+    return value;
+  };
+  if (index->size() < 8) return offsets;
+  uint64_t count = read(0);
+  if (index->size() != 8 + 16 * count) return offsets;
+
+  offsets.push_back(0);
+  for (uint64_t i = 0; i < count; i++)
+  {
+    uint64_t offset = read(8 + 16 * i);
+    if (offset <= offsets.back() || offset >= file_size) return {};
+    if (bgzfBlockSize(file.data() + offset, file_size - offset) == 0) return {};
+    offsets.push_back(offset);
+  }
+  return offsets;
+}
+
+/// Splits a BGZF file into groups of blocks, returns fewer than two groups if it is no BGZF file
+static std::vector<FrameInputSource::Frame> bgzfFrames(const MappedFile& file, const char* file_name)
+{
+  std::vector<FrameInputSource::Frame> frames;
+  const unsigned char* data = file.data();
+  size_t size = file.size();
+
+  std::vector<size_t> offsets = bgzfIndex(file_name, file);
+  if (offsets.empty())
+  {
+    for (size_t pos = 0, block; pos < size; pos += block)
+    {
+      block = bgzfBlockSize(data + pos, size - pos);
+      if (block == 0 || block > size - pos) return {};
+      offsets.push_back(pos);
+    }
+  }
+  offsets.push_back(size);
+
+  size_t begin = 0;
+  for (size_t i = 1; i < offsets.size(); i++)
+  {
+    if (offsets[i] - begin >= min_frame_size || i + 1 == offsets.size())
+    {
+      frames.push_back({data + begin, offsets[i] - begin});
+      begin = offsets[i];
+    }
+  }
+  return frames;
+}
+
+#ifdef FERP_HAVE_ZSTD
+/// Streams a zstd file through a single decompression context
+class ZstdInputSource : public ThreadedInputSource
+{
+  std::unique_ptr<MappedFile> file;
+  ZSTD_DCtx* ctx;
+  ZSTD_inBuffer in;
+  size_t pending; ///< Result of the last call that made progress, 0 at the end of a frame
+protected:
+  size_t produce(unsigned char* buf, size_t capacity)
+  {
+    ZSTD_outBuffer out = {buf, capacity, 0};
+    while (!failed() && out.pos < out.size)
+    {
+      size_t before = out.pos;
+      bool input_left = in.pos < in.size;
+      size_t res = ZSTD_decompressStream(ctx, &out, &in);
+      if (ZSTD_isError(res)) fail();
+      else if (input_left || out.pos != before) pending = res;
+      // the input ends within a frame if nothing is left to flush
+      else if (pending != 0) fail();
+      else break;
+    }
+    return failed() ? 0 : out.pos;
+  }
+public:
+  explicit ZstdInputSource(MappedFile* f) : file(f), ctx(ZSTD_createDCtx()), pending(0)
+  {
+    in = {file->data(), file->size(), 0};
+    if (ctx == nullptr) fail();
+  }
+  ~ZstdInputSource()
+  {
+    stop();
+    ZSTD_freeDCtx(ctx);
+  }
+};
+
+/// Decodes groups of zstd frames on several threads
+class ZstdFrameInputSource : public FrameInputSource
+{
+protected:
+  int decode(const Frame& frame, std::vector<unsigned char>& out) const
+  {
+    ZSTD_DCtx* ctx = ZSTD_createDCtx();
+    if (ctx == nullptr) return 1;
+    ZSTD_inBuffer in = {frame.data, frame.size, 0};
+    out.resize(std::max(4 * frame.size, (size_t)buffer_size));
+    size_t pos = 0, res = 0;
+    do
+    {
+      if (pos == out.size()) out.resize(2 * out.size());
+      ZSTD_outBuffer o = {out.data(), out.size(), pos};
+      res = ZSTD_decompressStream(ctx, &o, &in);
+      pos = o.pos;
+    } while (!ZSTD_isError(res) && (in.pos < in.size || pos == out.size()));
+    ZSTD_freeDCtx(ctx);
+    out.resize(pos);
+    return res != 0;
+  }
+public:
+  ZstdFrameInputSource(MappedFile* f, std::vector<Frame>&& fr, unsigned threads) : FrameInputSource(f, threads)
+  {
+    frames = std::move(fr);
+  }
+  ~ZstdFrameInputSource() { stop(); }
+};
+
+/// Splits a zstd file into groups of frames, returns fewer than two groups if that is not possible
+static std::vector<FrameInputSource::Frame> zstdFrames(const MappedFile& file)
+{
+  std::vector<FrameInputSource::Frame> frames;
+  const unsigned char* data = file.data();
+  size_t size = file.size();
+  while (size > 0)
+  {
+    size_t group = 0;
+    while (group < min_frame_size && group < size)
+    {
+      size_t frame = ZSTD_findFrameCompressedSize(data + group, size - group);
+      if (ZSTD_isError(frame)) return {};
+      group += frame;
+    }
+    frames.push_back({data, group});
+    data += group;
+    size -= group;
+  }
+  return frames;
+}
+#endif
+
+#ifdef FERP_HAVE_LZMA
+/// Streams an xz file, with liblzma 5.4 or newer blocks are decoded on several threads
+class XzInputSource : public ThreadedInputSource
+{
+  std::unique_ptr<MappedFile> file;
+  lzma_stream strm;
+  bool finished;
+protected:
+  size_t produce(unsigned char* buf, size_t capacity)
+  {
+    strm.next_out = buf;
+    strm.avail_out = capacity;
+    while (!finished && strm.avail_out > 0)
+    {
+      // the whole input is available from the start
+      // LZMA_BUF_ERROR means the file is truncated
+      lzma_ret ret = lzma_code(&strm, LZMA_FINISH);
+      if (ret == LZMA_STREAM_END) finished = true;
+      else if (ret != LZMA_OK)
+      {
+        fail();
+        finished = true;
+        return 0;
+      }
+    }
+    return capacity - strm.avail_out;
+  }
+public:
+  XzInputSource(MappedFile* f, unsigned threads) : file(f), strm(LZMA_STREAM_INIT), finished(false)
+  {
+    lzma_ret ret;
+#ifdef FERP_HAVE_LZMA_MT
+    if (threads > 1)
+    {
+      lzma_mt options = {};
+      options.flags = LZMA_CONCATENATED;
+      options.threads = threads;
+      options.memlimit_threading = UINT64_MAX;
+      options.memlimit_stop = UINT64_MAX;
+      ret = lzma_stream_decoder_mt(&strm, &options);
+    }
+    else
+#endif
+      ret = lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED);
+    if (ret != LZMA_OK)
+    {
+      fail();
+      finished = true;
+    }
+    strm.next_in = file->data();
+    strm.avail_in = file->size();
+  }
+  ~XzInputSource()
+  {
+    stop();
+    lzma_end(&strm);
+  }
+};
+#endif
+
+#ifdef FERP_HAVE_LZ4
+/// Streams an lz4 file through a single decompression context
+class Lz4InputSource : public ThreadedInputSource
+{
+  std::unique_ptr<MappedFile> file;
+  LZ4F_dctx* ctx;
+  size_t in_pos;
+  size_t pending; ///< Result of the last call that made progress, 0 at the end of a frame
+protected:
+  size_t produce(unsigned char* buf, size_t capacity)
+  {
+    size_t pos = 0;
+    while (!failed() && pos < capacity)
+    {
+      size_t out_size = capacity - pos, in_size = file->size() - in_pos;
+      size_t res = LZ4F_decompress(ctx, buf + pos, &out_size, file->data() + in_pos, &in_size, nullptr);
+      pos += out_size;
+      in_pos += in_size;
+      if (LZ4F_isError(res)) fail();
+      else if (out_size != 0 || in_size != 0) pending = res;
+      // the input ends within a frame if nothing is left to flush
+      else if (pending != 0) fail();
+      else break;
+    }
+    return failed() ? 0 : pos;
+  }
+public:
+  explicit Lz4InputSource(MappedFile* f) : file(f), ctx(nullptr), in_pos(0), pending(0)
+  {
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION))) fail();
+  }
+  ~Lz4InputSource()
+  {
+    stop();
+    LZ4F_freeDecompressionContext(ctx);
+  }
+};
+
+/// Decodes groups of lz4 frames on several threads
+/** Linked blocks only refer to earlier blocks of their own frame, so every frame
+ * can be decoded on its own.
+ */
+class Lz4FrameInputSource : public FrameInputSource
+{
+protected:
+  int decode(const Frame& frame, std::vector<unsigned char>& out) const
+  {
+    LZ4F_dctx* ctx;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION))) return 1;
+    out.resize(std::max(4 * frame.size, (size_t)buffer_size));
+    size_t in_pos = 0, pos = 0, res = 0;
+    do
+    {
+      if (pos == out.size()) out.resize(2 * out.size());
+      size_t out_size = out.size() - pos, in_size = frame.size - in_pos;
+      res = LZ4F_decompress(ctx, out.data() + pos, &out_size, frame.data + in_pos, &in_size, nullptr);
+      pos += out_size;
+      in_pos += in_size;
+    } while (!LZ4F_isError(res) && (in_pos < frame.size || pos == out.size()));
+    LZ4F_freeDecompressionContext(ctx);
+    out.resize(pos);
+    return res != 0;
+  }
+public:
+  Lz4FrameInputSource(MappedFile* f, std::vector<Frame>&& fr, unsigned threads) : FrameInputSource(f, threads)
+  {
+    frames = std::move(fr);
+  }
+  ~Lz4FrameInputSource() { stop(); }
+};
+
+/// Returns the size of the lz4 frame at \a data, 0 if there is no complete one
+/** Only the frame and block headers are read, skippable frames count as frames. */
+static size_t lz4FrameSize(const unsigned char* data, size_t size)
+{
+  auto read = [data](size_t pos) {
+    return (uint32_t)data[pos] | (uint32_t)data[pos + 1] << 8 | (uint32_t)data[pos + 2] << 16 | (uint32_t)data[pos + 3] << 24;
+  };
+  if (size < 8) return 0;
+  const uint32_t magic = read(0);
+  if ((magic & 0xfffffff0) == 0x184d2a50)
+  {
+    const uint64_t skipped = 8 + (uint64_t)read(4);
+    return skipped <= size ? (size_t)skipped : 0;
+  }
+  if (magic != 0x184d2204 || (data[4] & 0xc0) != 0x40) return 0;
+
+  // FLG holds the block checksum, content size, content checksum and dictionary id flags
+  const unsigned char flags = data[4];
+  const size_t block_checksum = flags & 0x10 ? 4 : 0;
+  size_t pos = 7 + (flags & 0x08 ? 8 : 0) + (flags & 0x01 ? 4 : 0);
+  for (;;)
+  {
+    if (pos + 4 > size) return 0;
+    // the highest bit marks uncompressed blocks, a size of 0 ends the frame
+    const uint32_t word = read(pos);
+    pos += 4;
+    if (word == 0) break;
+    const size_t block = word & 0x7fffffff;
+    if (block > size - pos || block_checksum > size - pos - block) return 0;
+    pos += block + block_checksum;
+  }
+  pos += flags & 0x04 ? 4 : 0;
+  return pos <= size ? pos : 0;
+}
+
+/// Splits an lz4 file into groups of frames, returns fewer than two groups if that is not possible
+static std::vector<FrameInputSource::Frame> lz4Frames(const MappedFile& file)
+{
+  std::vector<FrameInputSource::Frame> frames;
+  const unsigned char* data = file.data();
+  size_t size = file.size();
+  while (size > 0)
+  {
+    size_t group = 0;
+    while (group < min_frame_size && group < size)
+    {
+      size_t frame = lz4FrameSize(data + group, size - group);
+      if (frame == 0) return {};
+      group += frame;
+    }
+    frames.push_back({data, group});
+    data += group;
+    size -= group;
+  }
+  return frames;
+}
+#endif
+
+/// Opens the decompressor matching \a magic, returns nullptr if there is none
+static InputSource* openDecompressor(const char* file_name, const unsigned char* magic)
+{
+  MappedFile* file = nullptr;
+  if (magic[0] == 0x1f && magic[1] == 0x8b && hardwareThreads() > 1 &&
+      bgzfBlockSize(magic, 18) != 0 && (file = MappedFile::open(file_name)))
+  {
+    std::vector<FrameInputSource::Frame> frames = bgzfFrames(*file, file_name);
+    if (frames.size() > 1) return new BgzfInputSource(file, std::move(frames), hardwareThreads());
+    delete file;
+    return nullptr;
+  }
+#ifdef FERP_HAVE_ZSTD
+  static const unsigned char zstd_magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+  if (std::equal(zstd_magic, zstd_magic + sizeof(zstd_magic), magic) && (file = MappedFile::open(file_name)))
+  {
+    unsigned threads = hardwareThreads();
+    std::vector<FrameInputSource::Frame> frames;
+    if (threads > 1) frames = zstdFrames(*file);
+    if (frames.size() > 1) return new ZstdFrameInputSource(file, std::move(frames), threads);
+    return new ZstdInputSource(file);
+  }
+#endif
+#ifdef FERP_HAVE_LZMA
+  static const unsigned char xz_magic[] = {0xfd, '7', 'z', 'X', 'Z', 0x00};
+  if (std::equal(xz_magic, xz_magic + sizeof(xz_magic), magic) && (file = MappedFile::open(file_name)))
+    return new XzInputSource(file, hardwareThreads());
+#endif
+#ifdef FERP_HAVE_LZ4
+  static const unsigned char lz4_magic[] = {0x04, 0x22, 0x4d, 0x18};
+  if (std::equal(lz4_magic, lz4_magic + sizeof(lz4_magic), magic) && (file = MappedFile::open(file_name)))
+  {
+    unsigned threads = hardwareThreads();
+    std::vector<FrameInputSource::Frame> frames;
+    if (threads > 1) frames = lz4Frames(*file);
+    if (frames.size() > 1) return new Lz4FrameInputSource(file, std::move(frames), threads);
+    return new Lz4InputSource(file);
+  }
+#endif
+  return nullptr;
+}
+
+InputSource* InputSource::open(const char* file_name)
+{
+  bool standard_input = strcmp(file_name, "-") == 0;
+  int fd = standard_input ? dup(STDIN_FILENO) : ::open(file_name, O_RDONLY);
+  if (fd < 0) return nullptr;
+
+  struct stat st;
+  unsigned char magic[18] = {};
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return nullptr;
+  }
+  bool regular = !standard_input && S_ISREG(st.st_mode) && st.st_size > 0;
+
+  if (regular && pread(fd, magic, sizeof(magic), 0) >= 2)
+  {
+    InputSource* decompressor = openDecompressor(file_name, magic);
+    if (decompressor != nullptr)
+    {
+      close(fd);
+      return decompressor;
+    }
+  }
+
+  // only regular files are mapped, plain gzip data and pipes go through zlib
+  if (regular && !(magic[0] == 0x1f && magic[1] == 0x8b))
+  {
+    void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED)
+    {
+      madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+      close(fd);
+      return new MappedInputSource((const unsigned char*)map, (size_t)st.st_size);
+    }
+  }
+
+  if (!S_ISREG(st.st_mode)) return new PipeInputSource(fd);
+
+  gzFile in = gzdopen(fd, "rb");
+  if (in == Z_NULL)
+  {
+    close(fd);
+    return nullptr;
+  }
+  return new GzInputSource(in);
+}
@@ -0,0 +1,212 @@
+//
+// Input sources feeding the StreamBuffer of a Reader
+//
+
+#ifndef FERPCHECK_INPUTSOURCE_H
+#define FERPCHECK_INPUTSOURCE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const int buffer_size = 1048576;
+
+/// Abstract source of input bytes, handed out in contiguous blocks
+class InputSource
+{
+  std::atomic<bool> error; ///< Whether the input could not be decoded completely
+protected:
+  /// Reports that the input is broken, next() then ends it early
+  void fail();
+public:
+  InputSource() : error(false) {}
+  virtual ~InputSource() {}
+
+  /// Makes the next block of input available in \a data
+  /** The block stays valid until the next call.
+   * @return Size of the block, 0 at the end of input or after an error
+   */
+  virtual size_t next(const unsigned char*& data) = 0;
+
+  /// Returns true if the input ended because it could not be decoded
+  bool failed() const { return error; }
+
+  /// Returns true if the current block always holds the rest of the input
+  virtual bool contiguous() const { return false; }
+
+  /// Opens \a file_name, "-" stands for the standard input, returns nullptr on failure
+  /** Uncompressed regular files are memory mapped and parsed in place. zstd, xz
+   * and lz4 files are recognised by their magic bytes if the respective library
+   * was found at build time. BGZF files are inflated block-wise on several
+   * threads, using the block offsets of a `.gzi` index next to the file if there
+   * is one. Other gzip files are read through zlib, pipes with partial reads
+   * so that their data can be processed while it is written.
+   */
+  static InputSource* open(const char* file_name);
+};
+
+/// Produces blocks on a background thread, so decoding overlaps with parsing
+/** Blocks are filled into a ring of #num_slots buffers by produce(). Subclasses
+ * have to call stop() in their destructor before releasing what produce() uses.
+ * On a single core blocks are produced synchronously into the first slot.
+ */
+class ThreadedInputSource : public InputSource
+{
+  static const int num_slots = 4;
+
+  std::unique_ptr<unsigned char[]> slots[num_slots];
+  size_t sizes[num_slots];
+  unsigned filled;   ///< Number of filled slots, including the one handed out
+  unsigned head;     ///< Slot handed out by the last call to next()
+  bool handed_out;   ///< Whether #head is in use by the consumer
+  bool stopping;
+  bool threaded;
+
+  std::mutex mutex;
+  std::condition_variable slot_free;
+  std::condition_variable slot_filled;
+  std::thread producer;
+
+  void run();
+protected:
+  /// Fills \a buf with at most \a capacity bytes, returns 0 at the end of input
+  virtual size_t produce(unsigned char* buf, size_t capacity) = 0;
+
+  /// Stops the background thread
+  void stop();
+public:
+  ThreadedInputSource();
+  ~ThreadedInputSource();
+
+  size_t next(const unsigned char*& data);
+};
+
+/// Reads input through a gzFile (handles both compressed and plain files)
+class GzInputSource : public ThreadedInputSource
+{
+  gzFile in;
+protected:
+  size_t produce(unsigned char* buf, size_t capacity);
+public:
+  explicit GzInputSource(gzFile i) : in(i) {}
+  ~GzInputSource();
+};
+
+/// Reads a pipe or terminal, blocks are handed out as soon as data arrives
+/** gzip data is detected by its magic bytes and inflated on the fly. Reads wait
+ * in poll() together with #wake, so destruction does not hang on a pipe that
+ * is never closed.
+ */
+class PipeInputSource : public ThreadedInputSource
+{
+  int fd;
+  int wake[2];   ///< Pipe written on destruction to interrupt a waiting read
+  z_stream strm;
+  std::unique_ptr<unsigned char[]> in_buf;
+  bool started;  ///< Whether the first bytes have been read
+  bool gzip;
+  bool in_member; ///< Whether the gzip member being inflated is incomplete
+  bool finished;
+
+  /// Reads at most \a capacity bytes, returns 0 at the end of input, -1 on errors and -2 when interrupted
+  ssize_t readSome(unsigned char* buf, size_t capacity);
+protected:
+  size_t produce(unsigned char* buf, size_t capacity);
+public:
+  explicit PipeInputSource(int f);
+  ~PipeInputSource();
+};
+
+/// A read-only memory mapped file
+class MappedFile
+{
+  const unsigned char* data_;
+  size_t size_;
+  MappedFile(const unsigned char* d, size_t s) : data_(d), size_(s) {}
+public:
+  ~MappedFile();
+
+  /// Maps \a file_name, returns nullptr if it is no regular non-empty file or cannot be mapped
+  static MappedFile* open(const char* file_name);
+
+  const unsigned char* data() const { return data_; }
+  size_t size() const { return size_; }
+};
+
+/// Decodes independent frames of a mapped file on several threads
+/** Every decoded frame is handed out as one block in file order, at most
+ * #window frames are decoded ahead of the parser. Subclasses fill #frames and
+ * have to call stop() in their destructor.
+ */
+class FrameInputSource : public InputSource
+{
+public:
+  /// Compressed data in #file that can be decoded on its own
+  struct Frame
+  {
+    const unsigned char* data;
+    size_t size;
+  };
+
+protected:
+  std::unique_ptr<MappedFile> file;
+  std::vector<Frame> frames;
+
+  /// Decodes \a frame into \a out, called from several threads at once
+  /** @return 0 on success */
+  virtual int decode(const Frame& frame, std::vector<unsigned char>& out) const = 0;
+
+  /// Stops the worker threads
+  void stop();
+private:
+  unsigned num_threads;
+  unsigned window;
+  std::vector<std::vector<unsigned char>> outputs; ///< Decoded frames, frame i in slot i % #window
+  std::vector<int> states;                         ///< State of each slot: 0 empty, 1 decoded, 2 failed
+  size_t next_frame; ///< Next frame to be decoded
+  size_t current;    ///< Frame handed out by the last call to next()
+  bool handed_out;   ///< Whether #current is in use by the consumer
+  bool stopping;
+
+  std::mutex mutex;
+  std::condition_variable progress;
+  std::vector<std::thread> workers;
+
+  void run();
+public:
+  FrameInputSource(MappedFile* f, unsigned threads);
+  ~FrameInputSource();
+
+  size_t next(const unsigned char*& data);
+};
+
+/// Hands out a memory region as a single block, the region is not owned
+class MemoryInputSource : public InputSource
+{
+protected:
+  const unsigned char* data;
+  size_t size;
+  bool consumed;
+public:
+  MemoryInputSource(const unsigned char* d, size_t s) : data(d), size(s), consumed(false) {}
+
+  size_t next(const unsigned char*& block);
+  bool contiguous() const { return true; }
+};
+
+/// Hands out a memory mapped file as a single block
+class MappedInputSource : public MemoryInputSource
+{
+public:
+  MappedInputSource(const unsigned char* m, size_t s) : MemoryInputSource(m, s) {}
+  ~MappedInputSource();
+};
+
+#endif // FERPCHECK_INPUTSOURCE_H
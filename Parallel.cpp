@@ -0,0 +1,27 @@
+//
+// Settings of the parallel reading, decoding and checking
+//
+
+#include "Parallel.h"
+
+#include <stdlib.h>
+#include <thread>
+
+/// Value of the environment variable \a name, 0 if it is not set or no positive number
+static unsigned long testSetting(const char* name)
+{
+  const char* value = getenv(name);
+  return value != nullptr ? strtoul(value, nullptr, 10) : 0;
+}
+
+unsigned hardwareThreads()
+{
+  static const unsigned long threads = testSetting("FERP_TEST_THREADS");
+  return threads != 0 ? (unsigned)threads : std::thread::hardware_concurrency();
+}
+
+size_t splitSize(size_t size)
+{
+  static const unsigned long split = testSetting("FERP_TEST_SPLIT");
+  return split != 0 ? (size_t)split : size;
+}
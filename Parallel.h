@@ -0,0 +1,23 @@
+//
+// Settings of the parallel reading, decoding and checking
+//
+
+#ifndef FERPCHECK_PARALLEL_H
+#define FERPCHECK_PARALLEL_H
+
+#include <stddef.h>
+
+/// Number of threads for reading and decoding the inputs, the number of cores by default
+/** The environment variable FERP_TEST_THREADS overrides it, so the tests reach the
+ * parallel paths on a single core.
+ */
+unsigned hardwareThreads();
+
+/// Returns \a size, the size of the pieces an input or a check is split into for the threads
+/** Used for the minimum size of reader chunks and compressed frame groups and for the
+ * steps per thread of a checking round. The environment variable FERP_TEST_SPLIT
+ * replaces all of them, so the tests split their small inputs.
+ */
+size_t splitSize(size_t size);
+
+#endif //FERPCHECK_PARALLEL_H
@@ -3,6 +3,7 @@
 //
 
 #include <iostream>
+#include <thread>
 #include "QbfReader.h"
 
 int QbfReader::readQBF(Formula& f)
@@ -12,9 +13,14 @@ int QbfReader::readQBF(Formula& f)
   unsigned num_vars = 0;
   unsigned num_clauses = 0;
   
-  if (readHeader(num_vars, num_clauses)) return -1;
-  if (readPrefix(f)) return -2;
-  if (readMatrix(f)) return -3;
+  int res = 0;
+  if (readHeader(num_vars, num_clauses)) res = -1;
+  else if (readPrefix(f)) res = -2;
+  else if (readMatrix(f)) res = -3;
+  
+  // a broken compressed input ends early, the formula read so far is incomplete
+  if (stream.failed()) return -4;
+  if (res) return res;
   
   f.finalise();
   if (f.numVars() != num_vars)
@@ -103,6 +109,9 @@ int QbfReader::readQuant(Formula& f)
 
 int QbfReader::readMatrix(Formula& f)
 {
+  std::vector<Chunk> chunks;
+  splitInput(chunks, true);
+  if (!chunks.empty()) return readMatrixParallel(f, chunks);
   
   while (true)
   {
@@ -114,15 +123,57 @@ int QbfReader::readMatrix(Formula& f)
   return 0;
 }
 
-int QbfReader::readClause()
+int QbfReader::readMatrixParallel(Formula& f, const std::vector<Chunk>& chunks)
 {
-  Lit l = 0;
-  clause_.clear();
-  while (true)
+  std::vector<std::vector<Lit>> clauses(chunks.size());
+  std::vector<int> results(chunks.size(), 0);
+  
+  // tokenizing and simplification happen on the workers
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < chunks.size(); i++)
+    workers.emplace_back([&, i]()
+    {
+      MemoryInputSource source(chunks[i].begin, chunks[i].size);
+      QbfReader reader(source);
+      results[i] = reader.readChunk(clauses[i]);
+    });
+  for (std::thread& w : workers)
+    w.join();
+  stream.advance(stream.available());
+  
+  // quantifying free variables and building clauses must follow the original order
+  for (size_t i = 0; i < chunks.size(); i++)
   {
-    if (parseSigned(l)) return 7;
-    if (l == 0) break;
-    clause_.push_back(l);
+    if (results[i]) return 6;
+    const std::vector<Lit>& c = clauses[i];
+    size_t end = 0;
+    for (size_t begin = 0; begin < c.size(); begin = end + 1)
+    {
+      for (end = begin; c[end] != 0; end++);
+      f.addSimplifiedClause(c.data() + begin, c.data() + end);
+    }
+    std::vector<Lit>().swap(clauses[i]);
   }
+  
+  return 0;
+}
+
+int QbfReader::readChunk(std::vector<Lit>& clauses)
+{
+  skipWhitespace(stream);
+  while (*stream != EOF)
+  {
+    if (readClause()) return 7;
+    if (!Formula::simplifyClause(clause_)) continue;
+    clauses.insert(clauses.end(), clause_.begin(), clause_.end());
+    clauses.push_back(0);
+  }
+  return 0;
+}
+
+int QbfReader::readClause()
+{
+  clause_.clear();
+  if (parseLits(clause_)) return 7;
   return 0;
 }
@@ -29,6 +29,12 @@ private:
   /// Reads the whole matrix and adds it to \a f
   int readMatrix(Formula& f);
   
+  /// Reads the matrix split into \a chunks on several threads, clauses are added to \a f in order
+  int readMatrixParallel(Formula& f, const std::vector<Chunk>& chunks);
+  
+  /// Reads and simplifies all clauses of a chunk into \a clauses, each clause terminated by 0
+  int readChunk(std::vector<Lit>& clauses);
+  
   /// Reads a single clause, called by readMatrix(Formula&)
   int readClause();
 public:
@@ -36,7 +42,7 @@ public:
   int readQBF(Formula& f);
   
   /// Reader Constructor
-  QbfReader (gzFile& file) : Reader(file), type_(QuantType::NONE) {};
+  QbfReader (InputSource& source, unsigned num_threads = 1) : Reader(source, num_threads), type_(QuantType::NONE) {};
 };
 
 
@@ -3,15 +3,29 @@
 //
 
 #include "Reader.h"
+#include "Parallel.h"
 
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
 #include <algorithm>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_TOKENIZER
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define SIMD_TOKENIZER
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_TOKENIZER
+#endif
+
 int Reader::parseUnsigned(unsigned& ret)
 {
   if (*stream < '0' || *stream > '9')
   {
-    printf("Error while reading unsigned number\n");
+    if (!quiet) printf("Error while reading unsigned number\n");
     return 1;
   }
   
@@ -39,7 +53,7 @@ int Reader::parseSigned(int& ret)
   
   if (*stream < '0' || *stream > '9')
   {
-    printf("Error while reading signed number\n");
+    if (!quiet) printf("Error while reading signed number\n");
     return 2;
   }
   
@@ -56,4 +70,238 @@ int Reader::parseSigned(int& ret)
   return 0;
 }
 
+int Reader::parseVarint(uint64_t& ret)
+{
+  uint64_t result = 0;
+  
+  // decode straight from the block unless the varint may cross its end
+  if (stream.available() >= 10)
+  {
+    const unsigned char* p = stream.cursor();
+    for (unsigned i = 0; i < 10; i++)
+    {
+      result |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+      if (!(p[i] & 0x80))
+      {
+        ret = result;
+        stream.advance(i + 1);
+        return 0;
+      }
+    }
+    if (!quiet) printf("Error while reading varint\n");
+    return 1;
+  }
+  
+  for (unsigned shift = 0; shift < 70; shift += 7)
+  {
+    int c = *stream;
+    if (c == EOF) break;
+    ++stream;
+    result |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80))
+    {
+      ret = result;
+      return 0;
+    }
+  }
+  if (!quiet) printf("Error while reading varint\n");
+  return 1;
+}
+
+void Reader::splitInput(std::vector<Chunk>& chunks, bool at_terminator)
+{
+  // smaller pieces are not worth a thread
+  const size_t min_chunk_size = splitSize(1 << 22);
+  
+  chunks.clear();
+  if (threads < 2 || !stream.contiguous()) return;
+  
+  const unsigned char* begin = stream.cursor();
+  const unsigned char* end = begin + stream.available();
+  const size_t num_chunks = std::min((size_t)threads, stream.available() / min_chunk_size);
+  if (num_chunks < 2) return;
+  
+  const unsigned char* chunk_begin = begin;
+  for (size_t i = 1; i < num_chunks && chunk_begin < end; i++)
+  {
+    const unsigned char* p = std::max(chunk_begin, begin + i * (stream.available() / num_chunks));
+    while (p < end)
+    {
+      const unsigned char* nl = (const unsigned char*)memchr(p, '\n', end - p);
+      if (nl == nullptr)
+      {
+        p = end;
+        break;
+      }
+      p = nl + 1;
+      if (!at_terminator) break;
+      
+      // the line has to end with a 0 token, otherwise the clause may continue
+      const unsigned char* q = nl;
+      while (q > chunk_begin && (q[-1] == ' ' || q[-1] == '\t' || q[-1] == '\r')) q--;
+      if (q > chunk_begin && q[-1] == '0' && (q - 1 == begin || q[-2] < '0' || q[-2] > '9')) break;
+    }
+    if (p == end) break;
+    chunks.push_back(Chunk{chunk_begin, (size_t)(p - chunk_begin)});
+    chunk_begin = p;
+  }
+  chunks.push_back(Chunk{chunk_begin, (size_t)(end - chunk_begin)});
+  
+  if (chunks.size() < 2) chunks.clear();
+}
+
+// parseLits classifies the input in windows of 64 bytes: every byte gets a bit in
+// the digit, whitespace and minus masks, tokens are then cut out of the masks.
+// Without SIMD support parseLits falls back to parseSigned.
+#if defined(__AVX2__)
+
+static inline uint32_t inRange(__m256i v, char lo, char hi)
+{
+  // bytes >= 0x80 compare as negative and are never in range
+  return (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                                                         _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v)));
+}
+
+static inline uint32_t equals(__m256i v, char c)
+{
+  return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+}
+
+static inline void classify(const unsigned char* p, uint64_t& digit, uint64_t& space, uint64_t& minus)
+{
+  __m256i lo = _mm256_loadu_si256((const __m256i*)p);
+  __m256i hi = _mm256_loadu_si256((const __m256i*)(p + 32));
+  digit = (uint64_t)inRange(lo, '0', '9') | (uint64_t)inRange(hi, '0', '9') << 32;
+  space = (uint64_t)(inRange(lo, 9, 13) | equals(lo, ' ')) | (uint64_t)(inRange(hi, 9, 13) | equals(hi, ' ')) << 32;
+  minus = (uint64_t)equals(lo, '-') | (uint64_t)equals(hi, '-') << 32;
+}
+
+#elif defined(__SSE4_2__)
+
+static inline uint64_t inRanges(const __m128i ranges, int len, __m128i v)
+{
+  return (uint64_t)_mm_cvtsi128_si32(_mm_cmpestrm(ranges, len, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_BIT_MASK));
+}
+
+static inline void classify(const unsigned char* p, uint64_t& digit, uint64_t& space, uint64_t& minus)
+{
+  const __m128i digits = _mm_setr_epi8('0', '9', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i spaces = _mm_setr_epi8(9, 13, ' ', ' ', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  digit = space = minus = 0;
+  for (int i = 0; i < 4; i++)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)(p + 16 * i));
+    digit |= inRanges(digits, 2, v) << (16 * i);
+    space |= inRanges(spaces, 4, v) << (16 * i);
+    minus |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('-'))) << (16 * i);
+  }
+}
+
+#elif defined(__SSE2__)
+
+static inline uint64_t inRange(__m128i v, char lo, char hi)
+{
+  // bytes >= 0x80 compare as negative and are never in range
+  return (uint64_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                                                   _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1))));
+}
+
+static inline uint64_t equals(__m128i v, char c)
+{
+  return (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+}
+
+static inline void classify(const unsigned char* p, uint64_t& digit, uint64_t& space, uint64_t& minus)
+{
+  digit = space = minus = 0;
+  for (int i = 0; i < 4; i++)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)(p + 16 * i));
+    digit |= inRange(v, '0', '9') << (16 * i);
+    space |= (inRange(v, 9, 13) | equals(v, ' ')) << (16 * i);
+    minus |= equals(v, '-') << (16 * i);
+  }
+}
+
+#endif
+
+#ifdef SIMD_TOKENIZER
+static const size_t window_size = 64;
 
+/// Number of consecutive set bits in \a mask starting at bit 0
+static inline unsigned onesRun(uint64_t mask)
+{
+  return ~mask ? (unsigned)__builtin_ctzll(~mask) : 64;
+}
+#endif // SIMD_TOKENIZER
+
+int Reader::parseLits(std::vector<Lit>& lits)
+{
+  while (true)
+  {
+#ifdef SIMD_TOKENIZER
+    if (stream.available() >= window_size)
+    {
+      const unsigned char* begin = stream.cursor();
+      const unsigned char* end = begin + stream.available() - window_size;
+      const unsigned char* p = begin;
+      bool irregular = false;
+      
+      while (!irregular && p <= end)
+      {
+        uint64_t digit, space, minus;
+        classify(p, digit, space, minus);
+        
+        unsigned i = onesRun(space);
+        while (i < window_size)
+        {
+          const unsigned start = i;
+          const bool neg = (minus >> i) & 1;
+          i += neg;
+          
+          // the number might continue in the next window
+          const unsigned n = (i < window_size) ? onesRun(digit >> i) : 0;
+          if (i + n >= window_size && n <= 9)
+          {
+            i = start;
+            break;
+          }
+          // errors and numbers which could overflow are left to parseSigned
+          if (n == 0 || n > 9)
+          {
+            i = start;
+            irregular = true;
+            break;
+          }
+          
+          int value = 0;
+          for (const unsigned char* d = p + i; d < p + i + n; d++)
+            value = value * 10 + (*d - '0');
+          i += n;
+          
+          if (value == 0)
+          {
+            stream.advance(p + i - begin);
+            skipWhitespace(stream);
+            return 0;
+          }
+          lits.push_back(neg ? -value : value);
+          
+          i += onesRun(space >> i);
+        }
+        p += i;
+      }
+      
+      stream.advance(p - begin);
+      if (p != begin && !irregular) continue;
+    }
+#endif // SIMD_TOKENIZER
+    
+    // close to the end of the block or an unusual token, go one by one
+    skipWhitespace(stream);
+    Lit l = 0;
+    if (parseSigned(l)) return 2;
+    if (l == 0) return 0;
+    lits.push_back(l);
+  }
+}
@@ -16,16 +16,40 @@
 class Reader
 {
 protected:
+  /// A line aligned part of the input, parsed by its own thread
+  struct Chunk
+  {
+    const unsigned char* begin;
+    size_t size;
+  };
+  
   StreamBuffer stream; ///< Input stream
+  unsigned threads;    ///< Number of threads used for large sections of the input
+  bool quiet;          ///< Whether parse errors go unreported, for chunks that are read again on failure
+  
+  /// Splits the rest of the input into at most #threads chunks ending at line boundaries
+  /** If \a at_terminator is set, only lines ending with the token 0 end a chunk.
+   * Leaves \a chunks empty if the input is not contiguous or too small to be split.
+   */
+  void splitInput(std::vector<Chunk>& chunks, bool at_terminator);
   
   /// Parses an unsigned integer, which is a Var
   int parseUnsigned(unsigned& ret);
   
   /// Parses a signed integer, which is a Lit
   int parseSigned(int& ret);
+  
+  /// Parses an unsigned LEB128 varint as used by binary formats
+  int parseVarint(uint64_t& ret);
+  
+  /// Parses a zero-terminated list of Lit and appends it to \a lits
+  /** Same result as calling parseSigned(int&) until it reads 0, but whole lines
+   * are decoded straight out of the current input block using SIMD instructions.
+   */
+  int parseLits(std::vector<Lit>& lits);
 public:
   /// Reader Constructor
-  Reader (gzFile& file) : stream(file) {}
+  Reader (InputSource& source, unsigned num_threads = 1) : stream(source), threads(num_threads ? num_threads : 1), quiet(false) {}
 };
 
 
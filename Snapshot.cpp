@@ -0,0 +1,556 @@
+//
+// On-disk snapshots of parsed inputs
+//
+
+#include "Snapshot.h"
+#include "FerpManager.h"
+#include "Formula.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+//////////// HASHING ////////////
+
+static const uint64_t prime1 = 0x9e3779b185ebca87ULL;
+static const uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+static const uint64_t prime3 = 0x165667b19e3779f9ULL;
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hashRound(uint64_t h, uint64_t w)
+{
+  return rotl(h + w * prime2, 31) * prime1;
+}
+
+/// 64-bit hash with four independent lanes, in the style of xxHash64
+static uint64_t hashBytes(const unsigned char* data, size_t size)
+{
+  uint64_t lanes[4] = {prime1 + prime2, prime2, 0, 0 - prime1};
+  size_t i = 0;
+
+  for (; i + 32 <= size; i += 32)
+    for (int k = 0; k < 4; k++)
+    {
+      uint64_t w;
+      memcpy(&w, data + i + 8 * k, 8);
+      lanes[k] = hashRound(lanes[k], w);
+    }
+
+  uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+  for (int k = 0; k < 4; k++)
+    h = (h ^ hashRound(0, lanes[k])) * prime1 + prime3;
+  h += size;
+
+  for (; i < size; i++)
+    h = rotl(h ^ (data[i] * prime3), 11) * prime1;
+
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+  return h;
+}
+
+//////////// FILE LAYOUT ////////////
+
+// A snapshot is a header followed by sections. Every section starts with a 64-bit
+// count and is padded to 8 bytes, so all arrays in a mapped snapshot are aligned.
+
+static const uint32_t snapshot_version = 2;
+static const uint32_t formula_kind = 1;
+static const uint32_t ferp_kind = 2;
+
+struct SnapshotHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t kind;
+  uint32_t layout;     ///< Sizes of the stored structures, snapshots do not move between builds
+  uint32_t endianness;
+  uint64_t hash;
+  uint64_t input_size;
+};
+
+static uint32_t layoutTag()
+{
+  return (uint32_t)(sizeof(Quant) << 16 | sizeof(Clause) << 8 | sizeof(Lit));
+}
+
+/// Number of words occupied by a quantifier, as allocated by Quant::make_quant
+static inline size_t quantWords(size_t size)
+{
+  return sizeof(Quant) / sizeof(Var) + size - 2;
+}
+
+/// Whether \a v can be the variable of a literal
+static inline bool validVar(Var v)
+{
+  return v != 0 && v <= (Var)INT32_MAX;
+}
+
+
+class SnapshotWriter
+{
+  FILE* out;
+  uint64_t written;
+public:
+  bool failed;
+
+  explicit SnapshotWriter(FILE* o) : out(o), written(0), failed(false) {}
+
+  void bytes(const void* p, size_t n)
+  {
+    if (n != 0 && fwrite(p, 1, n, out) != n) failed = true;
+    written += n;
+  }
+
+  void pad()
+  {
+    static const char zeros[8] = {0};
+    bytes(zeros, (8 - written % 8) % 8);
+  }
+
+  void value(uint64_t v) { bytes(&v, sizeof(v)); }
+
+  template<class T>
+  void array(const T* data, size_t n)
+  {
+    value(n);
+    bytes(data, n * sizeof(T));
+    pad();
+  }
+
+  template<class T>
+  void array(const std::vector<T>& v) { array(v.data(), v.size()); }
+
+  /// Writes lists as end offsets followed by the concatenated lists
+  template<class T>
+  void lists(const FlatLists<T>& l)
+  {
+    array(l.endsData(), l.size());
+    array(l.valuesData(), l.numValues());
+  }
+
+  /// Writes the annotations of \a table in the format of lists(const FlatLists<T>&)
+  void lists(const AnnotationTable& table)
+  {
+    std::vector<uint64_t> ends;
+    for (uint32_t i = 0; i < table.size(); i++)
+      ends.push_back(table.end(i) - table.begin(0));
+    array(ends);
+    array(table.begin(0), table.end(table.size() - 1) - table.begin(0));
+  }
+
+  /// Writes the clauses of \a arena in the format of lists(const FlatLists<T>&)
+  void lists(const ClauseArena& arena)
+  {
+    std::vector<uint64_t> ends;
+    uint64_t end = 0;
+    for (uint32_t i = 0; i < arena.size(); i++)
+      ends.push_back(end += arena[i].size());
+    array(ends);
+    value(end);
+    for (uint32_t i = 0; i < arena.size(); i++)
+      bytes(arena[i].begin(), arena[i].size() * sizeof(Lit));
+    pad();
+  }
+};
+
+class SnapshotReader
+{
+  const unsigned char* p;
+  const unsigned char* end;
+public:
+  SnapshotReader(const unsigned char* b, const unsigned char* e) : p(b), end(e) {}
+
+  bool value(uint64_t& v)
+  {
+    if (end - p < (ptrdiff_t)sizeof(v)) return false;
+    memcpy(&v, p, sizeof(v));
+    p += sizeof(v);
+    return true;
+  }
+
+  /// Returns the \a n elements of the next array, nullptr if the snapshot is truncated
+  template<class T>
+  const T* array(uint64_t& n)
+  {
+    if (!value(n) || n > (uint64_t)(end - p) / sizeof(T)) return nullptr;
+    const T* a = (const T*)p;
+    size_t bytes = (n * sizeof(T) + 7) & ~(size_t)7;
+    p = bytes > (size_t)(end - p) ? end : p + bytes;
+    return a;
+  }
+
+  template<class T>
+  bool vector(std::vector<T>& v)
+  {
+    uint64_t n;
+    const T* a = array<T>(n);
+    if (a == nullptr) return false;
+    v.assign(a, a + n);
+    return true;
+  }
+
+  /// Returns the values of the next lists, their \a num_lists end offsets in \a ends, nullptr if the snapshot is broken
+  template<class T>
+  const T* lists(const uint64_t*& ends, uint64_t& num_lists)
+  {
+    uint64_t num_values;
+    ends = array<uint64_t>(num_lists);
+    if (ends == nullptr) return nullptr;
+    const T* values = array<T>(num_values);
+    if (values == nullptr) return nullptr;
+
+    uint64_t begin = 0;
+    for (uint64_t i = 0; i < num_lists; i++)
+    {
+      if (ends[i] < begin || ends[i] > num_values) return nullptr;
+      begin = ends[i];
+    }
+    return begin == num_values ? values : nullptr;
+  }
+};
+
+//////////// CACHE ////////////
+
+SnapshotCache::Key SnapshotCache::key(const char* file_name)
+{
+  Key key = {0, 0, false};
+  MappedFile* input = MappedFile::open(file_name);
+  if (input == nullptr) return key;
+
+  madvise((void*)input->data(), input->size(), MADV_SEQUENTIAL);
+  key.hash = hashBytes(input->data(), input->size());
+  key.size = input->size();
+  key.valid = true;
+  delete input;
+  return key;
+}
+
+std::string SnapshotCache::path(const Key& key, const char* suffix) const
+{
+  char name[64];
+  snprintf(name, sizeof(name), "/%016llx-%llu.%s", (unsigned long long)key.hash, (unsigned long long)key.size, suffix);
+  return directory + name;
+}
+
+MappedFile* SnapshotCache::open(const Key& key, uint32_t kind, const char* suffix,
+                                const unsigned char*& begin, const unsigned char*& end)
+{
+  if (!key.valid) return nullptr;
+
+  MappedFile* snapshot = MappedFile::open(path(key, suffix).c_str());
+  if (snapshot == nullptr) return nullptr;
+
+  SnapshotHeader header;
+  if (snapshot->size() >= sizeof(header))
+    memcpy(&header, snapshot->data(), sizeof(header));
+
+  if (snapshot->size() < sizeof(header) || memcmp(header.magic, "FERPSNAP", 8) != 0 ||
+      header.version != snapshot_version || header.kind != kind || header.layout != layoutTag() ||
+      header.endianness != 0x01020304 || header.hash != key.hash || header.input_size != key.size)
+  {
+    delete snapshot;
+    return nullptr;
+  }
+
+  begin = snapshot->data() + sizeof(header);
+  end = snapshot->data() + snapshot->size();
+  return snapshot;
+}
+
+/// Writes a snapshot to a temporary file and moves it into place once it is complete
+template<class F>
+static int writeSnapshot(const std::string& path, uint32_t kind, uint64_t hash, uint64_t size, F body)
+{
+  std::string tmp_path = path + ".tmp" + std::to_string(getpid());
+  FILE* out = fopen(tmp_path.c_str(), "wb");
+  if (out == nullptr) return 1;
+
+  SnapshotHeader header;
+  memcpy(header.magic, "FERPSNAP", 8);
+  header.version = snapshot_version;
+  header.kind = kind;
+  header.layout = layoutTag();
+  header.endianness = 0x01020304;
+  header.hash = hash;
+  header.input_size = size;
+
+  SnapshotWriter w(out);
+  w.bytes(&header, sizeof(header));
+  body(w);
+
+  bool failed = w.failed | (fclose(out) != 0);
+  if (failed || rename(tmp_path.c_str(), path.c_str()) != 0)
+  {
+    unlink(tmp_path.c_str());
+    return 2;
+  }
+  return 0;
+}
+
+int SnapshotCache::store(const Key& key, const Formula& f)
+{
+  if (!key.valid) return 1;
+
+  return writeSnapshot(path(key, "qbf"), formula_kind, key.hash, key.size, [&](SnapshotWriter& w)
+  {
+    w.value(f.num_exists);
+    w.value(f.num_forall);
+    w.array(f.quant_depth);
+    w.array(f.quant_position);
+    w.array(f.position_counters);
+    w.array(f.position_offset);
+
+    uint64_t words = 0;
+    for (const Quant* q : f.prefix)
+      words += quantWords(q->size);
+    w.value(f.prefix.size());
+    w.value(words);
+    for (const Quant* q : f.prefix)
+      w.bytes(q, quantWords(q->size) * sizeof(Var));
+    w.pad();
+
+    // clause records are stored one after the other, in the arena as in a loaded snapshot
+    words = 0;
+    if (!f.matrix.empty())
+    {
+      const Clause* last = f.getClause((unsigned)f.matrix.size() - 1);
+      words = f.matrix.back() + Clause::words(last->size_a + last->size_e);
+    }
+    w.value(f.matrix.size());
+    w.array(f.clauses, words);
+  });
+}
+
+int SnapshotCache::load(const Key& key, Formula& f)
+{
+  const unsigned char* begin;
+  const unsigned char* end;
+  MappedFile* snapshot = open(key, formula_kind, "qbf", begin, end);
+  if (snapshot == nullptr) return 1;
+
+  SnapshotReader r(begin, end);
+  uint64_t num_exists, num_forall, num_quants, num_clauses, words;
+  bool ok = r.value(num_exists) && r.value(num_forall) &&
+            r.vector(f.quant_depth) && r.vector(f.quant_position) &&
+            r.vector(f.position_counters) && r.vector(f.position_offset);
+
+  // records point straight into the mapping
+  std::vector<Quant*> prefix;
+  const unsigned* quants = ok && r.value(num_quants) ? r.array<unsigned>(words) : nullptr;
+  for (uint64_t i = 0, pos = 0; quants != nullptr && i < num_quants; i++)
+  {
+    Quant* q = (Quant*)(quants + pos);
+    if (pos + 1 > words || pos + quantWords(q->size) > words)
+    {
+      quants = nullptr;
+      break;
+    }
+    prefix.push_back(q);
+    pos += quantWords(q->size);
+  }
+
+  std::vector<size_t> matrix;
+  const int* clauses = quants != nullptr && r.value(num_clauses) ? r.array<int>(words) : nullptr;
+  matrix.reserve(clauses != nullptr ? num_clauses : 0);
+  for (uint64_t i = 0, pos = 0; clauses != nullptr && i < num_clauses; i++)
+  {
+    const Clause* c = (const Clause*)(clauses + pos);
+    if (pos + 3 > words || pos + Clause::words((uint64_t)c->size_a + c->size_e) > words)
+    {
+      clauses = nullptr;
+      break;
+    }
+    matrix.push_back(pos);
+    pos += Clause::words(c->size_a + c->size_e);
+  }
+
+  if (clauses == nullptr || prefix.empty())
+  {
+    f.quant_depth.clear();
+    f.quant_position.clear();
+    f.position_counters.assign(1, 0);
+    f.position_offset.clear();
+    delete snapshot;
+    return 2;
+  }
+
+  f.num_exists = (unsigned)num_exists;
+  f.num_forall = (unsigned)num_forall;
+  f.prefix.swap(prefix);
+  f.matrix.swap(matrix);
+  f.clauses = clauses;
+  f.snapshot = snapshot;
+  f.buildOccurrences();
+  return 0;
+}
+
+int SnapshotCache::store(const Key& key, const FerpManager& mngr)
+{
+  if (!key.valid) return 1;
+
+  return writeSnapshot(path(key, "ferp"), ferp_kind, key.hash, key.size, [&](SnapshotWriter& w)
+  {
+    w.value(mngr.is_sat);
+    w.value(mngr.root);
+
+    std::vector<uint32_t> pairs;
+    mngr.prop_to_original.forEach([&](Var prop, Var orig)
+    {
+      pairs.push_back(prop);
+      pairs.push_back(orig);
+    });
+    w.array(pairs);
+
+    // annotations are shared between variables, they are stored by id
+    w.lists(mngr.annotations);
+    pairs.clear();
+    mngr.prop_to_annotation.forEach([&](Var prop, uint32_t anno)
+    {
+      pairs.push_back(prop);
+      pairs.push_back(anno);
+    });
+    w.array(pairs);
+
+    w.array(mngr.trace_id_to_cnf_id);
+    w.lists(mngr.trace_clauses);
+    pairs.clear();
+    for (const std::array<uint32_t, 2>& ante : mngr.antecedents)
+    {
+      pairs.push_back(ante[0]);
+      pairs.push_back(ante[1]);
+    }
+    w.array(pairs);
+
+    // helper definitions in the format of lists(), ordered by variable
+    std::vector<Var> helpers;
+    std::vector<uint64_t> helper_ends;
+    std::vector<Lit> helper_lits;
+    mngr.helper_rows.forEach([&](Var helper, uint32_t row)
+    {
+      helpers.push_back(helper);
+      helper_lits.insert(helper_lits.end(), mngr.helper_lits.begin() + mngr.helper_offsets[row],
+                         mngr.helper_lits.begin() + mngr.helper_offsets[row + 1]);
+      helper_ends.push_back(helper_lits.size());
+    });
+    w.array(helpers);
+    w.array(helper_ends);
+    w.array(helper_lits);
+
+    // a loaded manager points into the snapshot for the nor clauses
+    w.lists(mngr.nor_clauses);
+    w.lists(mngr.nor_originals);
+    w.array(mngr.res_clause_ids);
+  });
+}
+
+int SnapshotCache::load(const Key& key, FerpManager& mngr)
+{
+  const unsigned char* begin;
+  const unsigned char* end;
+  MappedFile* snapshot = open(key, ferp_kind, "ferp", begin, end);
+  if (snapshot == nullptr) return 1;
+
+  // the snapshot has been written by store(const Key&, const FerpManager&) from a
+  // consistent manager, only the structure is validated here. Everything is
+  // validated before the manager is touched, so a broken snapshot leaves it empty.
+  SnapshotReader r(begin, end);
+  uint64_t is_sat = 0, root = 0, num_prop = 0, num_annotations = 0, num_trace = 0, num_ids = 0, n = 0;
+  uint64_t num_helpers = 0, num_rows = 0, num_nor = 0, num_originals = 0, num_res = 0;
+  const uint64_t* annotation_ends = nullptr;
+  const uint64_t* trace_ends = nullptr;
+  const uint64_t* helper_ends = nullptr;
+  const uint64_t* nor_ends = nullptr;
+  const uint64_t* originals_ends = nullptr;
+  const uint32_t* prop_originals = nullptr;
+  const uint32_t* prop_annotations = nullptr;
+  const Lit* annotation_lits = nullptr;
+  const uint32_t* ids = nullptr;
+  const Lit* trace_lits = nullptr;
+  const uint32_t* pairs = nullptr;
+  const Var* helpers = nullptr;
+  const Lit* helper_lits = nullptr;
+  const Lit* nor_lits = nullptr;
+  const uint32_t* originals = nullptr;
+  const uint32_t* res_ids = nullptr;
+
+  bool ok = r.value(is_sat) && r.value(root) &&
+            (prop_originals = r.array<uint32_t>(num_prop)) != nullptr &&
+            (annotation_lits = r.lists<Lit>(annotation_ends, num_annotations)) != nullptr &&
+            (prop_annotations = r.array<uint32_t>(n)) != nullptr && n == num_prop &&
+            (ids = r.array<uint32_t>(num_ids)) != nullptr &&
+            (trace_lits = r.lists<Lit>(trace_ends, num_trace)) != nullptr &&
+            (pairs = r.array<uint32_t>(n)) != nullptr && n == 2 * num_trace && num_ids == num_trace &&
+            (helpers = r.array<Var>(num_helpers)) != nullptr &&
+            (helper_lits = r.lists<Lit>(helper_ends, num_rows)) != nullptr && num_rows == num_helpers &&
+            (nor_lits = r.lists<Lit>(nor_ends, num_nor)) != nullptr &&
+            (originals = r.lists<uint32_t>(originals_ends, num_originals)) != nullptr &&
+            num_originals == (num_nor == 0 ? 0 : nor_ends[num_nor - 1]) &&
+            (res_ids = r.array<uint32_t>(num_res)) != nullptr;
+  ok = ok && num_annotations > 0 && annotation_ends[0] == 0 && num_annotations < UINT32_MAX &&
+       num_trace < UINT32_MAX && num_prop % 2 == 0;
+
+  // both maps list the expansion variables in ascending order and the helpers
+  // are ascending too, so no variable is added twice below
+  for (uint64_t i = 0; ok && i < num_prop; i += 2)
+    ok = (i == 0 || prop_originals[i] > prop_originals[i - 2]) && validVar(prop_originals[i]) &&
+         validVar(prop_originals[i + 1]) && prop_annotations[i] == prop_originals[i] &&
+         prop_annotations[i + 1] < num_annotations;
+  for (uint64_t i = 0, j = 0; ok && i < num_helpers; i++)
+  {
+    while (j < num_prop && prop_originals[j] < helpers[i]) j += 2;
+    ok = (i == 0 || helpers[i] > helpers[i - 1]) && validVar(helpers[i]) &&
+         (j == num_prop || prop_originals[j] != helpers[i]);
+  }
+
+  IdIndex cnf_id_to_trace_id;
+  for (uint32_t i = 0; ok && i < num_trace; i++)
+    ok = cnf_id_to_trace_id.insert(ids[i], i);
+
+  if (!ok)
+  {
+    delete snapshot;
+    return 2;
+  }
+
+  mngr.is_sat = is_sat != 0;
+  mngr.root = (uint32_t)root;
+  mngr.annotations.assign(annotation_lits, annotation_ends, (uint32_t)num_annotations);
+  for (uint64_t i = 0; i < num_prop; i += 2)
+    mngr.addExpansionVariable(prop_originals[i], prop_originals[i + 1], prop_annotations[i + 1]);
+
+  mngr.trace_id_to_cnf_id.assign(ids, ids + num_ids);
+  mngr.cnf_id_to_trace_id = std::move(cnf_id_to_trace_id);
+  mngr.antecedents.reserve(num_trace);
+  for (uint64_t i = 0; i < num_trace; i++)
+  {
+    const uint64_t first = i == 0 ? 0 : trace_ends[i - 1];
+    mngr.trace_clauses.add(trace_lits + first, trace_ends[i] - first);
+    mngr.antecedents.push_back({{pairs[2 * i], pairs[2 * i + 1]}});
+  }
+
+  // helper rows are numbered in the order they are stored
+  for (uint32_t i = 0; i < num_helpers; i++)
+  {
+    mngr.var_kinds.insert(helpers[i], FerpManager::VAR_HELPER);
+    mngr.helper_rows.insert(helpers[i], i);
+  }
+  mngr.helper_offsets.assign(1, 0);
+  mngr.helper_offsets.insert(mngr.helper_offsets.end(), helper_ends, helper_ends + num_rows);
+  mngr.helper_lits.assign(helper_lits, helper_lits + (num_rows == 0 ? 0 : helper_ends[num_rows - 1]));
+
+  // nor clauses stay in the mapping, with one list of original clauses per literal
+  mngr.nor_clauses.attach(nor_ends, num_nor, nor_lits);
+  mngr.nor_originals.attach(originals_ends, num_originals, originals);
+  mngr.res_clause_ids.assign(res_ids, res_ids + num_res);
+  mngr.snapshot = snapshot;
+  return 0;
+}
@@ -0,0 +1,60 @@
+//
+// On-disk snapshots of parsed inputs
+//
+
+#ifndef FERPCHECK_SNAPSHOT_H
+#define FERPCHECK_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "InputSource.h"
+
+class Formula;
+class FerpManager;
+
+/// Directory of snapshots of finalised Formula and FerpManager objects
+/** Snapshots are keyed by a 64-bit hash of the input file and its size. A Formula
+ * snapshot stores prefix and matrix in their in-memory layout, a loaded Formula
+ * keeps the snapshot mapped and points into it instead of allocating clauses.
+ * A loaded FerpManager points into its snapshot for the nor clauses of SAT
+ * traces, trace clauses, annotations and helper definitions are copied in bulk.
+ */
+class SnapshotCache
+{
+public:
+  /// Identifies the content of an input file
+  struct Key
+  {
+    uint64_t hash;
+    uint64_t size;
+    bool valid; ///< False if the input can not be hashed, e.g. because it is a pipe
+  };
+
+  explicit SnapshotCache(const char* dir) : directory(dir) {}
+
+  /// Hashes the content of \a file_name
+  static Key key(const char* file_name);
+
+  /// Restores \a f from its snapshot, \a f has to be freshly constructed
+  /** @return 0 on success, non-zero if there is no usable snapshot */
+  int load(const Key& key, Formula& f);
+
+  /// Restores \a mngr from its snapshot, \a mngr has to be freshly constructed
+  /** All sections are validated before \a mngr is filled, on failure it is left unchanged. */
+  int load(const Key& key, FerpManager& mngr);
+
+  /// Writes the snapshot of the finalised Formula \a f
+  int store(const Key& key, const Formula& f);
+
+  /// Writes the snapshot of \a mngr right after reading the trace
+  int store(const Key& key, const FerpManager& mngr);
+
+private:
+  std::string directory; ///< Directory holding the snapshot files
+
+  std::string path(const Key& key, const char* suffix) const;
+  MappedFile* open(const Key& key, uint32_t kind, const char* suffix, const unsigned char*& begin, const unsigned char*& end);
+};
+
+#endif //FERPCHECK_SNAPSHOT_H
@@ -0,0 +1,155 @@
+//
+// Map from variables to values, flat over a dense range of variables
+//
+
+#ifndef FERPCHECK_VARMAP_H
+#define FERPCHECK_VARMAP_H
+
+#include <stddef.h>
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "common.h"
+
+/// Maps variables to values of type \a T
+/** Variables of the range #base, #base + 1, ... are stored in a flat array, the
+ * range grows as long as at least a quarter of it is in use. Variables outside
+ * of it go to a hash map. Absent variables read as T().
+ */
+template <typename T>
+class VarMap
+{
+  Var base;                          ///< First variable of the dense range
+  std::vector<T> dense;              ///< Values of the dense range
+  std::vector<bool> present;         ///< Whether a variable of the dense range is in the map
+  std::unordered_map<Var, T> sparse; ///< Values of variables outside the dense range
+  size_t count;                      ///< Number of variables in the map
+  Var max_var;                       ///< Largest variable in the map
+
+  /// Extends the dense range to \a v if it stays dense enough, returns false otherwise
+  bool grow(Var v);
+public:
+  VarMap() : base(0), count(0), max_var(0) {}
+
+  /// Maps \a v to \a value, returns false if \a v is already in the map
+  bool insert(Var v, const T& value);
+
+  /// Returns the value of \a v, nullptr if \a v is not in the map
+  inline const T* find(Var v) const;
+
+  bool contains(Var v) const { return find(v) != nullptr; }
+
+  /// Returns the value of \a v, T() if \a v is not in the map
+  T get(Var v) const
+  {
+    const T* value = find(v);
+    return value != nullptr ? *value : T();
+  }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  Var maxVar() const { return max_var; }
+
+  /// Calls \a f(v, value) for all variables of the map in ascending order
+  template <typename F>
+  void forEach(F f) const;
+
+  void clear();
+};
+
+//////////// INLINE IMPLEMENTATIONS ////////////
+
+template <typename T>
+inline const T* VarMap<T>::find(Var v) const
+{
+  // unsigned wrap-around also sends variables below base to the hash map
+  size_t offset = (size_t)v - base;
+  if (v >= base && offset < dense.size())
+    return present[offset] ? &dense[offset] : nullptr;
+  if (sparse.empty()) return nullptr;
+  auto it = sparse.find(v);
+  return it != sparse.end() ? &it->second : nullptr;
+}
+
+template <typename T>
+bool VarMap<T>::grow(Var v)
+{
+  Var begin = dense.empty() ? v : std::min(base, v);
+  Var end = dense.empty() ? v + 1 : std::max<Var>(base + (Var)dense.size(), v + 1);
+  if ((size_t)(end - begin) > 4 * (count + 1) + 1024) return false;
+
+  if (begin < base && !dense.empty())
+  {
+    // rare, variables usually arrive in ascending order
+    size_t shift = base - begin;
+    dense.insert(dense.begin(), shift, T());
+    present.insert(present.begin(), shift, false);
+  }
+  base = begin;
+  dense.resize(end - begin, T());
+  present.resize(end - begin, false);
+
+  // variables of the new range move over from the hash map
+  for (auto it = sparse.begin(); it != sparse.end();)
+  {
+    if (it->first >= begin && it->first < end)
+    {
+      dense[it->first - begin] = std::move(it->second);
+      present[it->first - begin] = true;
+      it = sparse.erase(it);
+    }
+    else it++;
+  }
+  return true;
+}
+
+template <typename T>
+bool VarMap<T>::insert(Var v, const T& value)
+{
+  if (contains(v)) return false;
+
+  if ((v >= base && (size_t)v - base < dense.size()) || grow(v))
+  {
+    dense[v - base] = value;
+    present[v - base] = true;
+  }
+  else sparse.emplace(v, value);
+
+  count++;
+  max_var = std::max(max_var, v);
+  return true;
+}
+
+template <typename T>
+template <typename F>
+void VarMap<T>::forEach(F f) const
+{
+  std::vector<Var> outside;
+  outside.reserve(sparse.size());
+  for (const auto& entry : sparse)
+    outside.push_back(entry.first);
+  std::sort(outside.begin(), outside.end());
+
+  // the dense range lies between the hashed variables below and above it
+  auto above = std::lower_bound(outside.begin(), outside.end(), base);
+  for (auto it = outside.begin(); it != above; it++)
+    f(*it, sparse.find(*it)->second);
+  for (size_t i = 0; i < dense.size(); i++)
+    if (present[i]) f((Var)(base + i), dense[i]);
+  for (auto it = above; it != outside.end(); it++)
+    f(*it, sparse.find(*it)->second);
+}
+
+template <typename T>
+void VarMap<T>::clear()
+{
+  base = 0;
+  dense.clear();
+  present.clear();
+  sparse.clear();
+  count = 0;
+  max_var = 0;
+}
+
+#endif //FERPCHECK_VARMAP_H
@@ -1,60 +1,79 @@
-#include <zlib.h>
 #include <memory>
+#include <string.h>
 
 #include "FerpReader.h"
+#include "Parallel.h"
 #include "QbfReader.h"
+#include "Snapshot.h"
 
 int main(int argc, const char* argv[])
 {
-  if(argc != 4)
+  const char* cache_dir = nullptr;
+  int arg = 1;
+  if (argc > 2 && strcmp(argv[1], "--cache") == 0)
   {
-    printf("usage: %s <QBF> <FERP> <AIGER>\n", argv[0]);
-    return -1;
+    cache_dir = argv[2];
+    arg = 3;
   }
   
-  const char* qbf_name = argv[1];
-  const char* ferp_name = argv[2];
-  const char* aig_name = argv[3];
-  
-  gzFile qbf_file = gzopen(qbf_name, "rb");
-  
-  if (qbf_file == Z_NULL)
+  if(argc - arg != 3)
   {
-    printf("Could not open file: %s", qbf_name);
-    return -2;
+    printf("usage: %s [--cache <DIR>] <QBF> <FERP> <AIGER>\n", argv[0]);
+    return -1;
   }
+  
+  const char* qbf_name = argv[arg + 0];
+  const char* ferp_name = argv[arg + 1];
+  const char* aig_name = argv[arg + 2];
 
+  // snapshots of parsed inputs, keyed by their content
+  std::unique_ptr<SnapshotCache> cache(cache_dir != nullptr ? new SnapshotCache(cache_dir) : nullptr);
+  
   Formula qbf;
+  SnapshotCache::Key qbf_key = {0, 0, false};
+  if (cache) qbf_key = SnapshotCache::key(qbf_name);
+  if (!cache || cache->load(qbf_key, qbf) != 0)
   {
-    std::unique_ptr<QbfReader> qbf_reader(new QbfReader(qbf_file));
+    std::unique_ptr<InputSource> qbf_file(InputSource::open(qbf_name));
+    
+    if (!qbf_file)
+    {
+      printf("Could not open file: %s", qbf_name);
+      return -2;
+    }
+
+    std::unique_ptr<QbfReader> qbf_reader(new QbfReader(*qbf_file, hardwareThreads()));
     int res = qbf_reader->readQBF(qbf);
-    gzclose(qbf_file);
     if (res != 0)
     {
       printf("Something went wrong while reading QBF, code %d\n", res);
       return res;
     }
-  }
-
-  gzFile ferp_file = gzopen(ferp_name, "rb");
-  
-  if (ferp_file == Z_NULL)
-  {
-    printf("Could not open file: %s", ferp_name);
-    return -3;
+    if (cache) cache->store(qbf_key, qbf);
   }
 
   std::unique_ptr<FerpManager> fmngr(new FerpManager());
+  SnapshotCache::Key ferp_key = {0, 0, false};
+  if (cache) ferp_key = SnapshotCache::key(ferp_name);
+  if (!cache || cache->load(ferp_key, *fmngr) != 0)
   {
-    std::unique_ptr<FerpReader> ferp_reader(new FerpReader(ferp_file));
+    std::unique_ptr<InputSource> ferp_file(InputSource::open(ferp_name));
+    
+    if (!ferp_file)
+    {
+      printf("Could not open file: %s", ferp_name);
+      return -3;
+    }
+
+    std::unique_ptr<FerpReader> ferp_reader(new FerpReader(*ferp_file, hardwareThreads()));
 
     int res = ferp_reader->readFERP(*fmngr);
-    gzclose(ferp_file);
     if (res != 0)
     {
       printf("Something went wrong while reading FERP, code %d\n", res);
       return res;
     }
+    if (cache) cache->store(ferp_key, *fmngr);
   }
 
   fmngr->extract(qbf);
@@ -1,8 +1,11 @@
-#include <zlib.h>
 #include <memory>
+#include <stdlib.h>
+#include <string.h>
 
 #include "FerpReader.h"
+#include "Parallel.h"
 #include "QbfReader.h"
+#include "Snapshot.h"
 #include <sys/resource.h>
 
 // taken from qrpcheck
@@ -18,64 +21,124 @@ static inline double read_cpu_time()
 
 int main(int argc, const char* argv[])
 {
-  if(argc != 3)
+  const char* cache_dir = nullptr;
+  bool online = false;
+  bool backward = false;
+  unsigned threads = 1;
+  bool incremental = false;
+  int arg = 1;
+  while (arg < argc && strncmp(argv[arg], "--", 2) == 0)
   {
-    printf("usage: %s <QBF> <FERP>\n", argv[0]);
-    return -1;
+    if (strcmp(argv[arg], "--cache") == 0 && arg + 1 < argc)
+    {
+      cache_dir = argv[arg + 1];
+      arg += 2;
+    }
+    else if (strcmp(argv[arg], "--online") == 0)
+    {
+      online = true;
+      arg++;
+    }
+    else if (strcmp(argv[arg], "--backward") == 0)
+    {
+      backward = true;
+      arg++;
+    }
+    else if (strcmp(argv[arg], "--incremental") == 0)
+    {
+      incremental = true;
+      arg++;
+    }
+    else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc)
+    {
+      threads = (unsigned)strtoul(argv[arg + 1], nullptr, 10);
+      if (threads == 0) threads = hardwareThreads();
+      arg += 2;
+    }
+    else break;
   }
   
-  const char* qbf_name = argv[1];
-  const char* ferp_name = argv[2];
+  if(argc - arg != 2 || (online && backward))
+  {
+    printf("usage: %s [--cache <DIR>] [--threads <N>] [--incremental] [--online | --backward] <QBF> <FERP>\n", argv[0]);
+    printf("  <FERP> may be - for the standard input, --online checks steps while they are read\n");
+    printf("  --backward only checks steps the empty clause depends on and skips the others\n");
+    printf("  --threads checks the steps on N threads after reading, 0 uses all cores\n");
+    printf("  --incremental checks the eliminations of SAT traces with one solver per thread\n");
+    return -1;
+  }
   
-  double start_time = read_cpu_time();
+  const char* qbf_name = argv[arg + 0];
+  const char* ferp_name = argv[arg + 1];
 
-  gzFile qbf_file = gzopen(qbf_name, "rb");
+  // snapshots of parsed inputs, keyed by their content
+  std::unique_ptr<SnapshotCache> cache(cache_dir != nullptr ? new SnapshotCache(cache_dir) : nullptr);
   
-  if (qbf_file == Z_NULL)
-  {
-    printf("Could not open file: %s", qbf_name);
-    return -2;
-  }
+  double start_time = read_cpu_time();
 
   double start_qbf_read = read_cpu_time();
   Formula qbf;
+  SnapshotCache::Key qbf_key = {0, 0, false};
+  if (cache) qbf_key = SnapshotCache::key(qbf_name);
+  if (!cache || cache->load(qbf_key, qbf) != 0)
   {
-    std::unique_ptr<QbfReader> qbf_reader(new QbfReader(qbf_file));
+    std::unique_ptr<InputSource> qbf_file(InputSource::open(qbf_name));
+    
+    if (!qbf_file)
+    {
+      printf("Could not open file: %s", qbf_name);
+      return -2;
+    }
+
+    std::unique_ptr<QbfReader> qbf_reader(new QbfReader(*qbf_file, hardwareThreads()));
     int res = qbf_reader->readQBF(qbf);
-    gzclose(qbf_file);
     if (res != 0)
     {
       printf("Something went wrong while reading QBF, code %d\n", res);
       return res;
     }
+    if (cache) cache->store(qbf_key, qbf);
   }
   double qbf_read_time = read_cpu_time() - start_qbf_read;
   printf("FerpCheck read QBF: %.6f s\n", qbf_read_time);
 
-  gzFile ferp_file = gzopen(ferp_name, "rb");
-  
-  if (ferp_file == Z_NULL)
-  {
-    printf("Could not open file: %s", ferp_name);
-    return -3;
-  }
-
   double start_ferp_read = read_cpu_time();
   std::unique_ptr<FerpManager> fmngr(new FerpManager());
+  SnapshotCache::Key ferp_key = {0, 0, false};
+  if (cache) ferp_key = SnapshotCache::key(ferp_name);
+  if (!cache || cache->load(ferp_key, *fmngr) != 0)
   {
-    std::unique_ptr<FerpReader> ferp_reader(new FerpReader(ferp_file));
+    std::unique_ptr<InputSource> ferp_file(InputSource::open(ferp_name));
+    
+    if (!ferp_file)
+    {
+      printf("Could not open file: %s", ferp_name);
+      return -3;
+    }
 
+    std::unique_ptr<FerpReader> ferp_reader(new FerpReader(*ferp_file, hardwareThreads()));
+
+    if (online) fmngr->checkOnline(qbf);
     int res = ferp_reader->readFERP(*fmngr);
-    gzclose(ferp_file);
+    if (fmngr->online_result != 0)
+    {
+      printf("Something went wrong while checking FERP, code %d\n", fmngr->online_result);
+      return fmngr->online_result;
+    }
     if (res != 0)
     {
       printf("Something went wrong while reading FERP, code %d\n", res);
       return res;
     }
+    // online checking may already have released deleted clauses
+    if (cache && !online) cache->store(ferp_key, *fmngr);
   }
   double ferp_read_time = read_cpu_time() - start_ferp_read;
   printf("FerpCheck read FERP: %.6f s\n", ferp_read_time);
 
+  if (backward) fmngr->checkBackward();
+  fmngr->checkParallel(threads);
+  if (incremental) fmngr->checkIncremental();
   int res = fmngr->check(qbf);
   if(res != 0)
   {
@@ -92,6 +155,7 @@ int main(int argc, const char* argv[])
   printf("FerpCheck find assigment: %.6f s\n", fmngr->find_assignment_time);
   printf("FerpCheck eliminate clauses: %.6f s\n", fmngr->eliminate_clauses_time);
   printf("FerpCheck check resolution: %.6f s\n", fmngr->check_resolution_time);
+  if (backward) printf("FerpCheck skipped %u unreachable steps\n", fmngr->skipped_steps);
   printf("FerpCheck was running for %.6f s\n", cpu_time);
   return 0;
 }
\ No newline at end of file
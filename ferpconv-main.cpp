@@ -0,0 +1,61 @@
+#include <memory>
+#include <string.h>
+
+#include "FerpReader.h"
+#include "FerpWriter.h"
+
+int main(int argc, const char* argv[])
+{
+  bool text = argc == 4 && strcmp(argv[1], "-t") == 0;
+  if (argc != 3 && !text)
+  {
+    printf("usage: %s [-t] <FERP> <OUTPUT>\n", argv[0]);
+    printf("converts a text or binary FERP trace to binary format, or to text format with -t\n");
+    return -1;
+  }
+
+  const char* ferp_name = argv[argc - 2];
+  const char* out_name = argv[argc - 1];
+
+  std::unique_ptr<InputSource> ferp_file(InputSource::open(ferp_name));
+
+  if (!ferp_file)
+  {
+    printf("Could not open file: %s", ferp_name);
+    return -2;
+  }
+
+  FILE* out = strcmp(out_name, "-") == 0 ? stdout : fopen(out_name, "wb");
+
+  if (out == nullptr)
+  {
+    printf("Could not open file: %s", out_name);
+    return -3;
+  }
+
+  std::unique_ptr<FerpWriter> writer;
+  if (text)
+    writer.reset(new TextFerpWriter(out));
+  else
+    writer.reset(new BinaryFerpWriter(out));
+
+  {
+    std::unique_ptr<FerpReader> ferp_reader(new FerpReader(*ferp_file));
+
+    int res = ferp_reader->readFERP(*writer);
+    if (res != 0)
+    {
+      printf("Something went wrong while reading FERP, code %d\n", res);
+      return res;
+    }
+  }
+  ferp_file.reset();
+
+  if (writer->flush() || (out != stdout && fclose(out) != 0))
+  {
+    printf("Could not write file: %s\n", out_name);
+    return -4;
+  }
+
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include <memory>
+#include <string.h>
+
+#include "FerpReader.h"
+#include "FerpWriter.h"
+#include "Parallel.h"
+
+int main(int argc, const char* argv[])
+{
+  bool text = argc == 4 && strcmp(argv[1], "-t") == 0;
+  if (argc != 3 && !text)
+  {
+    printf("usage: %s [-t] <FERP> <OUTPUT>\n", argv[0]);
+    printf("keeps the steps the empty clause of an UNSAT trace depends on and renumbers them,\n");
+    printf("writes binary format, or text format with -t\n");
+    return -1;
+  }
+
+  const char* ferp_name = argv[argc - 2];
+  const char* out_name = argv[argc - 1];
+
+  std::unique_ptr<FerpManager> fmngr(new FerpManager());
+  {
+    std::unique_ptr<InputSource> ferp_file(InputSource::open(ferp_name));
+
+    if (!ferp_file)
+    {
+      printf("Could not open file: %s", ferp_name);
+      return -2;
+    }
+
+    std::unique_ptr<FerpReader> ferp_reader(new FerpReader(*ferp_file, hardwareThreads()));
+
+    int res = ferp_reader->readFERP(*fmngr);
+    if (res != 0)
+    {
+      printf("Something went wrong while reading FERP, code %d\n", res);
+      return res;
+    }
+  }
+
+  FILE* out = strcmp(out_name, "-") == 0 ? stdout : fopen(out_name, "wb");
+
+  if (out == nullptr)
+  {
+    printf("Could not open file: %s", out_name);
+    return -3;
+  }
+
+  std::unique_ptr<FerpWriter> writer;
+  if (text)
+    writer.reset(new TextFerpWriter(out));
+  else
+    writer.reset(new BinaryFerpWriter(out));
+
+  int res = fmngr->trim(*writer);
+  if (res != 0)
+  {
+    printf("Something went wrong while trimming FERP, code %d\n", res);
+    return res;
+  }
+
+  if (writer->flush() || (out != stdout && fclose(out) != 0))
+  {
+    printf("Could not write file: %s\n", out_name);
+    return -4;
+  }
+
+  // the statistics would end up in the trace otherwise
+  if (out != stdout)
+  {
+    printf("FerpTrim kept %u of %u steps\n", fmngr->kept_steps, (uint32_t)fmngr->trace_clauses.size() - 1);
+    printf("FerpTrim kept %u expansion variables\n", fmngr->kept_variables);
+  }
+  return 0;
+}
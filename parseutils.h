@@ -25,33 +25,31 @@ OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWA
 #include <stdio.h>
 #include <math.h>
 
-#include <zlib.h>
+#include "InputSource.h"
 
 //-------------------------------------------------------------------------------------------------
 // A simple buffered character stream class:
 
-static const int buffer_size = 1048576;
-
 
 class StreamBuffer
 {
-  gzFile in;
-  unsigned char buf[buffer_size];
-  int pos;
-  int size;
+  InputSource& in;
+  const unsigned char* buf;
+  size_t pos;
+  size_t size;
   
   void assureLookahead()
   {
     if (pos >= size)
     {
       pos = 0;
-      size = gzread(in, buf, sizeof(buf));
+      size = in.next(buf);
     }
   }
 
 public:
-  explicit StreamBuffer(gzFile i) :
-      in(i), pos(0), size(0)
+  explicit StreamBuffer(InputSource& i) :
+      in(i), buf(nullptr), pos(0), size(0)
   { assureLookahead(); }
   
   int operator*() const
@@ -63,8 +61,31 @@ public:
     assureLookahead();
   }
   
-  int position() const
+  size_t position() const
   { return pos; }
+  
+  /// Pointer to the unread part of the current block
+  const unsigned char* cursor() const
+  { return buf + pos; }
+  
+  /// Number of unread bytes in the current block
+  size_t available() const
+  { return pos < size ? size - pos : 0; }
+  
+  /// Returns true if the current block holds the rest of the input
+  bool contiguous() const
+  { return in.contiguous(); }
+  
+  /// Returns true if the input ended early because it could not be decoded
+  bool failed() const
+  { return in.failed(); }
+  
+  /// Consumes \a n bytes of the current block, \a n must not exceed available()
+  void advance(size_t n)
+  {
+    pos += n;
+    assureLookahead();
+  }
 };
 
 
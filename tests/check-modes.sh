@@ -0,0 +1,168 @@
+#!/bin/sh
+#
+# Checks the fixtures in every input format and checking mode against the sequential check
+#
+# usage: check-modes.sh <BUILD_DIR> <FIXTURE_DIR> [FORMAT...]
+# FORMAT is one of gz, xz, zst and lz4, formats without compressor on the PATH are skipped
+
+bin=$1
+fixtures=$2
+shift 2
+formats=$*
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+failures=0
+
+# expect <CODE> <DESCRIPTION> <COMMAND...>: runs the command and compares its exit code
+# shell variables are global, the callers must not use expected, what and res
+expect()
+{
+  expected=$1
+  what=$2
+  shift 2
+  "$@" > "$tmp/out" 2>&1
+  res=$?
+  if [ "$res" != "$expected" ]; then
+    echo "FAIL $what: exit code $res, expected $expected"
+    sed 's/^/  /' "$tmp/out"
+    failures=$((failures + 1))
+  fi
+}
+
+compressor()
+{
+  case $1 in
+    gz) echo gzip ;;
+    xz) echo xz ;;
+    zst) echo zstd ;;
+    lz4) echo lz4 ;;
+  esac
+}
+
+# check_trace <CODE> <QBF> <FERP>: the sequential check and every other mode give exit code CODE
+check_trace()
+{
+  code=$1
+  qbf=$fixtures/$2
+  ferp=$fixtures/$3
+  name="$3 on $2"
+  check=$bin/ferpcheck
+
+  expect "$code" "$name" "$check" "$qbf" "$ferp"
+  for mode in --online --backward "--threads 2" --incremental "--threads 2 --incremental"; do
+    expect "$code" "$name $mode" "$check" $mode "$qbf" "$ferp"
+  done
+
+  # the second run reloads both snapshots
+  rm -rf "$tmp/cache"
+  mkdir "$tmp/cache"
+  expect "$code" "$name --cache" "$check" --cache "$tmp/cache" "$qbf" "$ferp"
+  expect "$code" "$name --cache reload" "$check" --cache "$tmp/cache" "$qbf" "$ferp"
+
+  expect "$code" "$name from stdin" sh -c '"$1" "$2" - < "$3"' sh "$check" "$qbf" "$ferp"
+  expect "$code" "$name from pipe" sh -c 'cat "$3" | "$1" "$2" -' sh "$check" "$qbf" "$ferp"
+  expect "$code" "$name from gzip pipe" sh -c 'gzip -c "$3" | "$1" "$2" -' sh "$check" "$qbf" "$ferp"
+  gzip -c "$ferp" > "$tmp/pipe.gz"
+  head -c $(($(wc -c < "$tmp/pipe.gz") / 2)) "$tmp/pipe.gz" > "$tmp/pipe-cut.gz"
+  expect 3 "$name from truncated gzip pipe" sh -c 'cat "$3" | "$1" "$2" -' sh "$check" "$qbf" "$tmp/pipe-cut.gz"
+
+  # binary traces, deletions included, and their conversion back to text
+  expect 0 "$name ferpconv" "$bin/ferpconv" "$ferp" "$tmp/binary.ferp"
+  expect "$code" "$name binary" "$check" "$qbf" "$tmp/binary.ferp"
+  expect "$code" "$name binary --online" "$check" --online "$qbf" "$tmp/binary.ferp"
+  expect 0 "$name ferpconv -t" "$bin/ferpconv" -t "$tmp/binary.ferp" "$tmp/text.ferp"
+  expect "$code" "$name binary to text" "$check" "$qbf" "$tmp/text.ferp"
+  expect 0 "$name ferpconv -t of text" "$bin/ferpconv" -t "$tmp/text.ferp" "$tmp/text2.ferp"
+  expect 0 "$name stable text" cmp "$tmp/text.ferp" "$tmp/text2.ferp"
+
+  for format in $formats; do
+    command -v "$(compressor "$format")" > /dev/null || continue
+    "$(compressor "$format")" -c < "$qbf" > "$tmp/qbf.$format"
+    "$(compressor "$format")" -c < "$ferp" > "$tmp/ferp.$format"
+    expect "$code" "$name $format" "$check" "$tmp/qbf.$format" "$tmp/ferp.$format"
+    # a truncated file must not pass as a shorter trace
+    head -c $(($(wc -c < "$tmp/ferp.$format") / 2)) "$tmp/ferp.$format" > "$tmp/cut.$format"
+    expect 3 "$name truncated $format" "$check" "$qbf" "$tmp/cut.$format"
+  done
+}
+
+# same_output <DESCRIPTION> <COMMAND...>: the parallel run prints the same as the sequential one
+# the fixtures are split into pieces of 4 bytes, 4 steps per thread and round, and read on 4 threads
+same_output()
+{
+  what=$1
+  shift
+  { FERP_TEST_THREADS=1 "$@" 2>&1; echo "exit code $?"; } | grep -v ' s$' > "$tmp/sequential"
+  { FERP_TEST_THREADS=4 FERP_TEST_SPLIT=4 "$@" 2>&1; echo "exit code $?"; } | grep -v ' s$' > "$tmp/parallel"
+  expect 0 "$what" cmp "$tmp/sequential" "$tmp/parallel"
+}
+
+# check_parallel <QBF> <FERP>: the parallel readers, decoders and checks agree with sequential mode
+check_parallel()
+{
+  qbf=$fixtures/$1
+  ferp=$fixtures/$2
+  name="$2 on $1 split"
+  check=$bin/ferpcheck
+
+  # one token per line, steps span the chunk boundaries
+  awk '/^[sxr]/ { print; next } { gsub(/ /, "\n"); print }' "$ferp" > "$tmp/lines.ferp"
+  for mode in "" --backward "--threads 3" "--threads 3 --backward" "--threads 3 --incremental"; do
+    same_output "$name $mode" "$check" $mode "$qbf" "$ferp"
+    same_output "$name $mode multi-line steps" "$check" $mode "$qbf" "$tmp/lines.ferp"
+  done
+
+  # several frames per file, one for every 8 lines
+  split -l 8 "$ferp" "$tmp/piece."
+  for format in $formats; do
+    command -v "$(compressor "$format")" > /dev/null || continue
+    rm -f "$tmp/frames.$format"
+    for piece in "$tmp"/piece.*; do
+      "$(compressor "$format")" -c < "$piece" >> "$tmp/frames.$format"
+    done
+    same_output "$name $format frames" "$check" "$qbf" "$tmp/frames.$format"
+  done
+  rm -f "$tmp"/piece.*
+}
+
+check_trace 0 sat.qdimacs sat.ferp
+check_trace 0 unsat.qdimacs unsat.ferp
+check_trace 7 unsat.qdimacs unsat-broken.ferp
+check_trace 102 sat-broken.qdimacs sat.ferp
+
+check_parallel sat.qdimacs sat.ferp
+check_parallel unsat.qdimacs unsat.ferp
+check_parallel unsat.qdimacs unsat-broken.ferp
+check_parallel sat-broken.qdimacs sat.ferp
+
+# the failed assumptions are printed once, for the reported nor clause only
+"$bin/ferpcheck" --incremental "$fixtures/sat-broken.qdimacs" "$fixtures/sat.ferp" 2>&1 | grep Conflicting > "$tmp/conflict"
+"$bin/ferpcheck" --incremental --threads 2 "$fixtures/sat-broken.qdimacs" "$fixtures/sat.ferp" 2>&1 | grep Conflicting > "$tmp/conflict-threads"
+expect 0 "conflicting clauses" test -s "$tmp/conflict"
+expect 0 "conflicting clauses with --threads 2" cmp "$tmp/conflict" "$tmp/conflict-threads"
+
+# the trimmed trace still refutes the formula, SAT traces cannot be trimmed
+expect 0 "ferptrim" "$bin/ferptrim" "$fixtures/unsat.ferp" "$tmp/trimmed.ferp"
+expect 0 "trimmed trace" "$bin/ferpcheck" "$fixtures/unsat.qdimacs" "$tmp/trimmed.ferp"
+expect 0 "ferptrim -t" "$bin/ferptrim" -t "$fixtures/unsat.ferp" "$tmp/trimmed.txt"
+expect 0 "trimmed text trace" "$bin/ferpcheck" "$fixtures/unsat.qdimacs" "$tmp/trimmed.txt"
+expect 1 "ferptrim of SAT trace" "$bin/ferptrim" "$fixtures/sat.ferp" "$tmp/trimmed-sat.ferp"
+
+# the certificate depends neither on the trace encoding nor on the cache
+expect 0 "ferpcert" "$bin/ferpcert" "$fixtures/unsat.qdimacs" "$fixtures/unsat.ferp" "$tmp/cert.aag"
+"$bin/ferpconv" "$fixtures/unsat.ferp" "$tmp/binary.ferp" > /dev/null 2>&1
+expect 0 "ferpcert binary" "$bin/ferpcert" "$fixtures/unsat.qdimacs" "$tmp/binary.ferp" "$tmp/cert-binary.aag"
+expect 0 "ferpcert binary certificate" cmp "$tmp/cert.aag" "$tmp/cert-binary.aag"
+rm -rf "$tmp/cache"
+mkdir "$tmp/cache"
+for run in store reload; do
+  expect 0 "ferpcert --cache $run" "$bin/ferpcert" --cache "$tmp/cache" "$fixtures/unsat.qdimacs" "$fixtures/unsat.ferp" "$tmp/cert-$run.aag"
+  expect 0 "ferpcert --cache $run certificate" cmp "$tmp/cert.aag" "$tmp/cert-$run.aag"
+done
+
+if [ "$failures" -ne 0 ]; then
+  echo "$failures checks failed"
+  exit 1
+fi
+echo "all checks passed"